@@ -6,7 +6,11 @@
 ; Created: 6/10/2020
 ; Developed with AtmelStudio 7.0.129
 ;
-.equ OCR_value = 155 ; Compare register value
+.equ F_CPU = 10000000 ; CPU clock in Hz
+.equ OCR_value = ( F_CPU / 64 + 500 ) / 1000 - 1 ; Compare register value for 1ms with /64 prescaler
+.if OCR_value > 255
+	.error "1ms doesn't fit in timer0 with /64 prescaler"
+.endif
 
 .org $000
 rjmp init ; Start from initialization routine
@@ -7,8 +7,13 @@
 ; Developed with AtmelStudio 7.0.129
 ;
 
-; loop iterations
-.equ limit = 2498
+.equ F_CPU = 10000000 ; CPU clock in Hz
+
+; loop iterations for 1ms. 8 cycles outside the loop, 4 for each iteration.
+.equ limit = ( F_CPU / 1000 - 8 ) / 4
+.if limit > 65535
+	.error "1ms loop doesn't fit in a register pair"
+.endif
 
 ; initialization routine. Runs once at program start.
 init:
@@ -10,7 +10,10 @@
 ;
 
 
-.equ OCR_value = 77 ; Compare register value
+.equ OCR_value = ( F_CPU / 256 * 2 + 500 ) / 1000 - 1 ; Compare register value for 2ms with /256 prescaler
+.if OCR_value > 255
+	.error "2ms doesn't fit in timer0 with /256 prescaler"
+.endif
 ; internal SRAM starts at 0x0060
 .equ data_pointer = 0x0060 ; position of SRAM used to store data
 .equ segments_pointer = 0x0068 ; position of SRAM used to store 7 segments encodings
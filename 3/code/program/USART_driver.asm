@@ -8,8 +8,12 @@
 ; Developed with AtmelStudio 7.0.129
 ;
 
-; ( F_CPU / ( baudrate * 16 ) ) - 1 = ~64,1
-.equ UBBR_value = 64
+; ( F_CPU / ( baudrate * 16 ) ) - 1, rounded
+.equ UBBR_value = ( F_CPU + 8 * BAUD ) / ( 16 * BAUD ) - 1
+; same 2% bound as util/setbaud.h
+.if F_CPU / ( 16 * ( UBBR_value + 1 ) ) * 100 > BAUD * 102 || F_CPU / ( 16 * ( UBBR_value + 1 ) ) * 100 < BAUD * 98
+	.error "Baud rate error too high for this F_CPU"
+.endif
 
 ; Transmitter need an FSM. This position is used to keep the status.
 .equ transmiter_status_pointer = 0x0073
@@ -67,14 +71,15 @@ init_USART_driver:
 // Only the current input is needed to take the appropiate action.
 // arguments: none
 // returns: none
-// changes: r16, r17, r15(for debug)
+// changes: r16, r17
 //--------------------------------------------------------------------
 ISR_URXC:
 
 	; receive frame
-	in r16, UDR
-	in r16, UDR ; for debug
-	mov r16, r15 ; for debug
+	in r16, UDR ; one read, a second one pops the next frame
+.if stimuli_input
+	mov r16, r15 ; stimuli files load the frame in r15
+.endif
 	mov r17, r16 ; r16 change values in subroutines and need a reg with immediate capabilities.
 
 	cpi r17, 0x43 ; check if C
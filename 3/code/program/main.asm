@@ -14,6 +14,15 @@
 // pointer regs: r26, r27, r28, r29
 //--------------------------------------------------------------------
 
+.equ F_CPU = 10000000 ; CPU clock in Hz, used by the drivers
+.equ BAUD = 9600
+; 1: receive ISR takes the frame from r15, loaded by the stimuli files. 0: from UDR, for hardware.
+; The Debug configuration defines DEBUG.
+#ifdef DEBUG
+.equ stimuli_input = 1
+#else
+.equ stimuli_input = 0
+#endif
 
 
 ; Reset and Interrupt vectors
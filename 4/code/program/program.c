@@ -11,6 +11,7 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include "program.h"
 
 // __attribute__ ((section (".noinit"))) because there is no need to be 
@@ -26,7 +27,7 @@ void init_7_seg_driver();
 void init_USART_driver();
 /*-------------------------------------------------------------------------
 * Main function. Calls initialization functions, enables interrupt and 
-* stay in a infinite loop. Functionality is serviced through interrupts.
+* sleep in a infinite loop. Functionality is serviced through interrupts.
 *------------------------------------------------------------------------*/
 int main()
 {
@@ -36,16 +37,24 @@ int main()
 	init_7_seg_driver();
 	init_USART_driver();
 	
-	// Enable global interrupts
-	sei();
+	// Nothing to do between interrupts, sleep in IDLE until the next one.
+	// Sleep mode and SE are set once, while interrupts are still disabled.
+	set_sleep_mode( SLEEP_MODE_IDLE );
+	sleep_enable();
 	
-    while(1) 
-    {
-		// Visual debugger doesn't really like empty while loops.
-		// It shows that the loop loops at the previous line.
-		// Volatile so compiler doesn't optimize it away.
-		volatile int i = 0;
-    }
+	// Enable global interrupts, then sleep forever.
+	// The ISRs of 7_segment_driver.S and USART_driver.S save no registers and
+	// not SREG, so after sei the main loop is only sleep and a jump: it uses no
+	// register or flag that an ISR can change under it.
+	__asm__ __volatile__
+	(
+		"sei" "\n\t"
+		"1: sleep" "\n\t"
+		"rjmp 1b" "\n\t"
+		::: "memory"
+	);
+	
+	while(1); // never reached
 }
 
 
@@ -78,7 +87,7 @@ void init_7_seg_driver()
 	PORTC = 0b10000000; // in order to start from rightmost 7 segment
 	
 	// Set Timer0 at ~2ms
-	TCCR0 = ( 1 << CS02 ) | ( 1 << WGM01 );
+	TCCR0 = timer0_prescaler | ( 1 << WGM01 );
 	TIFR = 1 << TOV0;
 	TIMSK = 1 << OCIE0;
 	OCR0 = OCR_value;
@@ -94,9 +103,14 @@ void init_USART_driver()
 	DDRD |= ( 0 << 0 ); // RXD
 	DDRD |= ( 1 << 1 ); // TXD
 	
-	// Set UBRR for 9600 baud rate when clock is 10MHz
-	UBRRH = high( UBBR_value );
-	UBRRL = low( UBBR_value );
+	// Set UBRR for the BAUD profile, see baud_setup.h
+	UBRRH = baud_ubrr_value >> 8;
+	UBRRL = baud_ubrr_value & 0xFF;
+	#if baud_use_2x
+		UCSRA |= ( 1 << U2X );
+	#else
+		UCSRA &= ~( 1 << U2X );
+	#endif
 	
 	// UCSRA doesn't need to change, initial values are okay
 
@@ -12,8 +12,32 @@
 #ifndef PROGRAM_H_
 #define PROGRAM_H_
 	
-	// Compare register value
-	#define OCR_value 77
+	#define F_CPU 10000000
+	// USART baud rate profile: 9600, 38400, 115200, 250000, 500000 or 1000000.
+	// 115200 and 250000 use U2X at 10 MHz, 500000 and 1000000 need an 8 or 16 MHz clock.
+	#define BAUD 9600
+	#include "../../../common/baud_setup.h"
+	// 1: receive ISR takes the frame from r20, loaded by the stimuli files. 0: from UDR, for hardware.
+	// 1 in Debug builds, the Debug configuration passes DEBUG to the assembler too. See common/usart_input.h
+	#ifndef stimuli_input
+		#ifdef DEBUG
+			#define stimuli_input 1
+		#else
+			#define stimuli_input 0
+		#endif
+	#endif
+	
+	#include "../../../common/timer_setup.h"
+	
+	// Timer0 period, time each 7 segment stays lit
+	#define refresh_us 2000
+	// Compare register value and prescaler bits for timer0
+	#define OCR_value timer_compare( refresh_us, timer_8bit )
+	#define timer0_prescaler timer_cs_bits( refresh_us, timer_8bit )
+	#if timer_error( refresh_us, timer_8bit ) > timer_tolerance
+		#error "Timer0 can't make the refresh period with this F_CPU"
+	#endif
+	
 	// 1 data for each 7 segment
 	#define num_of_data 8
 
@@ -24,11 +48,4 @@
 	#define CR 0x0D
 	#define LF 0x0A
 
-	// ( F_CPU / ( baudrate * 16 ) ) - 1 = ~64,1
-	#define UBBR_value 64
-
-	// LOW, HIGH byte functionality from assembly to C
-	#define low(x)	( (x) & 0xFF )
-	#define high(x)	( ( (x) >> 8 ) & 0xFF )
-
 #endif /* PROGRAM_H_ */
\ No newline at end of file
@@ -2,6 +2,7 @@
  * 7_segment_driver.c
  *
  * Driver for an 8 digits 7 segment display. Shows data from SRAM.
+ * Data are stored already encoded in a ring buffer, so every refresh takes the same time.
  *
  * Created: 10/11/2020
  * Author: Emmanouil Petrakos
@@ -10,14 +11,109 @@
 
 #include <avr/io.h> // Required for the I/O registers macros
 #include <avr/interrupt.h> // Required for the ISR macro
+#include <avr/pgmspace.h> // Required for PROGMEM and pgm_read_byte
+#include "program.h"
 
-extern unsigned char data[8];
-extern unsigned char segments_encoding[11];
+extern unsigned char segments_data[num_of_data];
+extern unsigned char segments_head;
+extern unsigned char digit_index;
 
+// Segments are active low. Bit 7 is segment a, bit 0 is the decimal point.
+#define seg_a ( 1 << 7 )
+#define seg_b ( 1 << 6 )
+#define seg_c ( 1 << 5 )
+#define seg_d ( 1 << 4 )
+#define seg_e ( 1 << 3 )
+#define seg_f ( 1 << 2 )
+#define seg_g ( 1 << 1 )
+#define glyph( segments ) ( (unsigned char) ~( segments ) )
 
+// Encoding of every glyph code. Built by the compiler and read from flash by the USART driver.
+const unsigned char segments_encoding[] PROGMEM =
+{
+	glyph( seg_a | seg_b | seg_c | seg_d | seg_e | seg_f ), // 0
+	glyph( seg_b | seg_c ), // 1
+	glyph( seg_a | seg_b | seg_d | seg_e | seg_g ), // 2
+	glyph( seg_a | seg_b | seg_c | seg_d | seg_g ), // 3
+	glyph( seg_b | seg_c | seg_f | seg_g ), // 4
+	glyph( seg_a | seg_c | seg_d | seg_f | seg_g ), // 5
+	glyph( seg_a | seg_c | seg_d | seg_e | seg_f | seg_g ), // 6
+	glyph( seg_a | seg_b | seg_c ), // 7
+	glyph( seg_a | seg_b | seg_c | seg_d | seg_e | seg_f | seg_g ), // 8
+	glyph( seg_a | seg_b | seg_c | seg_d | seg_f | seg_g ), // 9
+	glyph( seg_a | seg_b | seg_c | seg_e | seg_f | seg_g ), // A
+	glyph( seg_c | seg_d | seg_e | seg_f | seg_g ), // b
+	glyph( seg_a | seg_d | seg_e | seg_f ), // C
+	glyph( seg_b | seg_c | seg_d | seg_e | seg_g ), // d
+	glyph( seg_a | seg_d | seg_e | seg_f | seg_g ), // E
+	glyph( seg_a | seg_e | seg_f | seg_g ), // F
+	glyph( 0 ), // blank
+	glyph( seg_g ), // -
+	glyph( seg_d ), // _
+	glyph( seg_b | seg_c | seg_e | seg_f | seg_g ), // H
+	glyph( seg_b | seg_c | seg_d | seg_e ), // J
+	glyph( seg_d | seg_e | seg_f ), // L
+	glyph( seg_c | seg_e | seg_g ), // n
+	glyph( seg_c | seg_d | seg_e | seg_g ), // o
+	glyph( seg_a | seg_b | seg_e | seg_f | seg_g ), // P
+	glyph( seg_e | seg_g ), // r
+	glyph( seg_d | seg_e | seg_f | seg_g ), // t
+	glyph( seg_b | seg_c | seg_d | seg_e | seg_f ), // U
+	glyph( seg_b | seg_c | seg_d | seg_f | seg_g ) // y
+};
+
+// Glyph codes of the lowercase letters. Capital letters are commands, a - f show
+// the hex digits and the letters without a glyph are blank.
+static const unsigned char letter_glyphs['z' - 'a' + 1] PROGMEM =
+{
+	0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, // a - f
+	glyph_blank, // g
+	glyph_H, // h
+	glyph_blank, // i
+	glyph_J, // j
+	glyph_blank, // k
+	glyph_L, // l
+	glyph_blank, // m
+	glyph_n, // n
+	glyph_o, // o
+	glyph_P, // p
+	glyph_blank, // q
+	glyph_r, // r
+	glyph_blank, // s
+	glyph_t, // t
+	glyph_U, // u
+	glyph_blank, glyph_blank, glyph_blank, // v - x
+	glyph_y, // y
+	glyph_blank // z
+};
+
+
+/*-------------------------------------------------------------------------
+* Segments encoding of a display frame: a digit, a lowercase letter, '-', '_'
+* or space. Other frames keep their low nibble, like the digits.
+*------------------------------------------------------------------------*/
+unsigned char ascii_segments( unsigned char frame )
+{
+	unsigned char code;
+	if( frame >= 'a' && frame <= 'z' )
+		code = pgm_read_byte( &letter_glyphs[frame - 'a'] );
+	else if( frame == '-' )
+		code = glyph_minus;
+	else if( frame == '_' )
+		code = glyph_underscore;
+	else if( frame == ' ' )
+		code = glyph_blank;
+	else
+		code = frame & 0x0F; // ascii -> bcd
+	return pgm_read_byte( &segments_encoding[code] );
+}
+
+
+#if !refresh_isr_asm
 //--------------------------------------------------------------------
 // Interrupt service routine for timer/counter0 compare match mode.
 // Controls 7 segments outputs.
+// 7_segment_refresh.S has the same routine in assembly.
 //--------------------------------------------------------------------
 ISR( TIMER0_COMP_vect )
 {
@@ -30,20 +126,13 @@ ISR( TIMER0_COMP_vect )
 	ring_counter = ( ring_counter >> 7 ) | ( ring_counter << 1 );
 	PORTC = ring_counter;
 	
-	// Get data based on ring counter. This block replaces assembly's ring_to_bcd
-	unsigned char shift_counter = 0;
-	while(1)
-	{
-		ring_counter >>= 1;
-		if( ring_counter != 0 )
-			shift_counter++;
-		else
-			break;
-	}
-	
-	//  Read from memory.
-	unsigned char bcd_number = data[shift_counter];
+	// Digit index moves together with the ring counter. It replaces assembly's ring_to_bcd
+	// and the shift loop, so the cost is the same for every digit.
+	unsigned char index = ( digit_index + 1 ) & ( num_of_data - 1 );
+	digit_index = index;
 
-	// Out to port. Replaces assembly's BCD_to_7_segment_Decoder and out
-	PORTA = segments_encoding[bcd_number];
-} // breakpoint here to check 7 segment ports
\ No newline at end of file
+	// Out to port. Data are already encoded by the USART driver.
+	// AN0 shows the head of the ring buffer, the rest of the digits follow it.
+	PORTA = segments_data[ ( segments_head + index ) & ( num_of_data - 1 ) ];
+} // breakpoint here to check 7 segment ports
+#endif
\ No newline at end of file
@@ -4,7 +4,11 @@
 
 7_segment_driver.c
 
+7_segment_refresh.S
+
 program.c
 
+reset_log.c
+
 USART_driver.c
 
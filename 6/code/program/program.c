@@ -11,28 +11,77 @@
 
 #include <avr/io.h> // Required for the I/O registers macros
 #include <avr/interrupt.h> // Required for the intrinsic function sei()
+#include <avr/pgmspace.h> // Required for PSTR
+#include <util/crc16.h> // Required for _crc_ccitt_update
+#include <stddef.h> // Required for offsetof
 #include "program.h"
+#include "../../../common/idle.h"
 
 
 // __attribute__ ((section (".noinit"))) because there is no need to be 
 // initialized to 0 by the compiler.
 // "volatile" to show to compiler that they can change outside the program.
-volatile unsigned char data[8] __attribute__ ((section (".noinit")));
-volatile unsigned char segments_encoding[11] __attribute__ ((section (".noinit")));
+// Display digits, kept by a warm start while their CRC matches
+volatile struct warm_state warm __attribute__ ((section (".noinit")));
+// Digit shown by the refresh ISR
+volatile unsigned char digit_index __attribute__ ((section (".noinit")));
 
-volatile unsigned char transmitter_status __attribute__ ((section (".noinit")));
-volatile unsigned char OK_transmits_left __attribute__ ((section (".noinit")));
-volatile unsigned char R_transmits_left __attribute__ ((section (".noinit")));
+// Reset telemetry. Newest record, written in its EEPROM slot by the EE_RDY ISR.
+volatile struct reset_record reset_log_newest __attribute__ ((section (".noinit")));
+volatile unsigned char reset_log_slot __attribute__ ((section (".noinit")));
+volatile unsigned char reset_log_written __attribute__ ((section (".noinit")));
+// MCUCSR flags of the resets in the ring, newest first
+volatile unsigned char reset_log_history[reset_log_records] __attribute__ ((section (".noinit")));
+volatile unsigned char reset_log_history_length __attribute__ ((section (".noinit")));
+// Next field of the E response, reset_log_fields when none
+volatile unsigned char reset_log_next __attribute__ ((section (".noinit")));
+
+// Transmit queue. Written by USART_send, read by the UDRE ISR.
+volatile unsigned char tx_buffer[tx_buffer_size] __attribute__ ((section (".noinit")));
+volatile unsigned char tx_head __attribute__ ((section (".noinit")));
+volatile unsigned char tx_tail __attribute__ ((section (".noinit")));
+// Messages ended but not acknowledged yet, see send_acks
+volatile unsigned long acks_pending __attribute__ ((section (".noinit")));
+
+// Receiver's ring buffer. Written by the receive ISR, read by USART_parse.
+volatile unsigned char rx_buffer[rx_buffer_size] __attribute__ ((section (".noinit")));
+volatile unsigned char rx_head __attribute__ ((section (".noinit")));
+volatile unsigned char rx_tail __attribute__ ((section (".noinit")));
+// Frames lost because the buffer was full
+volatile unsigned int rx_overruns __attribute__ ((section (".noinit")));
+// Link health counters, see the H message
+volatile unsigned int frame_errors __attribute__ ((section (".noinit")));
+volatile unsigned int data_overruns __attribute__ ((section (".noinit")));
+volatile unsigned int parity_errors __attribute__ ((section (".noinit")));
+volatile unsigned int tx_queue_full __attribute__ ((section (".noinit")));
+volatile unsigned long acks_coalesced __attribute__ ((section (".noinit")));
+volatile unsigned long rx_bytes __attribute__ ((section (".noinit")));
+volatile unsigned long tx_bytes __attribute__ ((section (".noinit")));
+volatile unsigned char rx_peak __attribute__ ((section (".noinit")));
+// Copy of the counters sent by the H response, and its next field. link_stats_fields when none.
+volatile unsigned long link_stats[link_stats_fields] __attribute__ ((section (".noinit")));
+volatile unsigned char link_stats_next __attribute__ ((section (".noinit")));
+// Set while flow control stops the host
+volatile unsigned char rx_throttled __attribute__ ((section (".noinit")));
+// XON or XOFF waiting for the transmitter, 0 when none
+volatile unsigned char tx_flow_byte __attribute__ ((section (".noinit")));
 
 void init_7_seg_driver_IO();
 void init_7_seg_driver_mem();
 void init_USART_driver_IO();
 void init_USART_driver_mem();
+void USART_parse();
+unsigned char USART_busy();
+void warm_state_commit();
+void reset_log_record( unsigned char reset_source );
+static unsigned char warm_state_intact();
+unsigned char USART_send_string_P( const char * string );
 
 
 /*-------------------------------------------------------------------------
 * Main function. Checks reset source, calls appropriate initialization functions, 
-* enables interrupt and stay in a infinite loop. Functionality is serviced through interrupts.
+* enables interrupt and stay in a infinite loop that parses the received messages
+* and sleeps when there are none.
 *------------------------------------------------------------------------*/
 int main()
 {
@@ -49,31 +98,39 @@ int main()
 	init_7_seg_driver_IO();
 	init_USART_driver_IO();
 	
-	// if power-on reset, or warm start is disabled
-	if( ( reset_source & ( 1 << PORF ) ) || !warm_start_enable )
-	{	// Watchdog reset doesn't affect SRAM, no need to be initialized again
+	// if power-on reset, warm start is disabled or the kept state is corrupted
+	if( ( reset_source & ( 1 << PORF ) ) || !warm_start_enable || !warm_state_intact() )
+		// Watchdog reset doesn't affect SRAM, intact digits need no initialization.
+		// A wild write before the reset leaves a CRC that doesn't match.
 		init_7_seg_driver_mem();
-		init_USART_driver_mem();
-	}
+	// The transmit queue changes in the UDRE ISR and has no CRC, it always starts empty.
+	// Responses queued before the reset are lost, the R response tells the host.
+	init_USART_driver_mem();
 
 	// Send reset response
 	if( reset_source & ( 1 << WDRF ) )
 	{
-		// Increase reset pending responses counter
-		R_transmits_left++;
-		// Enable transmitter interrupts to start the response
-		UCSRB |= ( 1 << UDRIE );
+		#if flow_xon_xoff
+			// Ring buffer was emptied, a host stopped before the reset can go on.
+			// Sent before the response, which enables the transmitter.
+			tx_flow_byte = XON;
+		#endif
+		// Queue the reset response
+		USART_send_string_P( PSTR( "R\r\n" ) );
 	}
 	
 	// Enable global interrupts
 	sei(); // Breakpoint here to execute stimuli file
 	
+	// Count the reset in EEPROM. Interrupts run while the ring is read, the EE_RDY ISR writes the record.
+	reset_log_record( reset_source );
+	
     while(1) 
     {
-		// Visual debugger doesn't really like empty while loops.
-		// It shows that the loop loops at the previous line.
-		// Volatile so compiler doesn't optimize it away.
-		volatile int i = 0;
+		// Messages are parsed here, interrupts only store the frames
+		USART_parse();
+		// Sleep until the next interrupt when there are no frames to parse
+		idle_unless( USART_busy() );
     }
 }
 
@@ -88,9 +145,11 @@ void init_7_seg_driver_IO()
 	DDRC = 0xFF;
 	PORTA = 0xFF; // all segments off
 	PORTC = 0b10000000; // in order to start from rightmost 7 segment (AN0)
+	// Previous digit of AN0, same as the ring counter in PORTC
+	digit_index = num_of_data - 1;
 	
 	// Set Timer0 at ~2ms
-	TCCR0 = ( 1 << CS02 ) | ( 1 << WGM01 );
+	TCCR0 = timer0_prescaler | ( 1 << WGM01 );
 	TIMSK = 1 << OCIE0;
 	OCR0 = OCR_value;
 }
@@ -103,20 +162,43 @@ void init_7_seg_driver_mem()
 {
 	// Set data
 	for( unsigned char i = 0 ; i < num_of_data ; i++ )
-	data[i] = 0x0A;
-	
-	// Set encodings
-	segments_encoding[0] = 0b00000011;
-	segments_encoding[1] = 0b10011111;
-	segments_encoding[2] = 0b00100101;
-	segments_encoding[3] = 0b00001101;
-	segments_encoding[4] = 0b10011001;
-	segments_encoding[5] = 0b01001001;
-	segments_encoding[6] = 0b01000001;
-	segments_encoding[7] = 0b00011111;
-	segments_encoding[8] = 0b00000001;
-	segments_encoding[9] = 0b00001001;
-	segments_encoding[10] = 0b11111111;
+	warm.data[i] = blank_segments;
+	// Rightmost digit (AN0) is at the head of the ring buffer
+	warm.head = 0;
+	warm_state_commit();
+}
+
+
+/*-------------------------------------------------------------------------
+* CRC of the warm start state, all fields before crc.
+*------------------------------------------------------------------------*/
+static unsigned int warm_state_crc()
+{
+	const volatile unsigned char * bytes = (const volatile unsigned char *) &warm;
+	unsigned int crc = warm_crc_seed;
+	for( unsigned char i = 0 ; i < offsetof( struct warm_state, crc ) ; i++ )
+		crc = _crc_ccitt_update( crc, bytes[i] );
+	return crc;
+}
+
+
+/*-------------------------------------------------------------------------
+* Refresh the CRC of the warm start state. Called after every change of it,
+* from the main loop only. A reset between a change and its commit leaves a
+* CRC that doesn't match, the half changed state isn't kept.
+*------------------------------------------------------------------------*/
+void warm_state_commit()
+{
+	warm.crc = warm_state_crc();
+}
+
+
+/*-------------------------------------------------------------------------
+* Returns 1 if the warm start state matches its CRC.
+*------------------------------------------------------------------------*/
+static unsigned char warm_state_intact()
+{
+	return warm.crc == warm_state_crc();
 }
 
 /*-------------------------------------------------------------------------
@@ -127,15 +209,19 @@ void init_USART_driver_IO()
 	// Set RXD as input and TXD as output.
 	DDRD |= ( 0 << 0 ); // RXD
 	DDRD |= ( 1 << 1 ); // TXD
+	#if flow_rts
+		// RTS output, low lets the host send
+		rts_port &= ~( 1 << rts_pin );
+		rts_DDR |= ( 1 << rts_pin );
+	#endif
 	
-	// Set UBRR for 9600 baud rate when clock is 10MHz. Let compiler calculate the correct values
-	#include <util/setbaud.h>
-	UBRRH = UBRRH_VALUE;
-	UBRRL = UBRRL_VALUE;
-	#if USE_2X
-		UCSRA |= (1 << U2X);
+	// Set UBRR for the BAUD profile, see baud_setup.h
+	UBRRH = baud_ubrr_value >> 8;
+	UBRRL = baud_ubrr_value & 0xFF;
+	#if baud_use_2x
+		UCSRA |= ( 1 << U2X );
 	#else
-		UCSRA &= ~(1 << U2X);
+		UCSRA &= ~( 1 << U2X );
 	#endif
 	// UCSRA doesn't need to change, initial values are okay
 
@@ -146,6 +232,26 @@ void init_USART_driver_IO()
 	// Write in UCSRC: URSEL = 1. Asynchronous operation: UMSEL = 0.
 	// Parity Disabled: UPM1:0 = 00. 8 bit word: UCSZ1:0 = 11
 	UCSRC = ( 1 << URSEL ) | ( 1 << UCSZ1 ) | ( 1 << UCSZ0 );
+	
+	// Empty receiver's ring buffer on every reset. Frames of an interrupted message are lost.
+	rx_head = 0;
+	rx_tail = 0;
+	// Host isn't stopped, RTS is low
+	rx_throttled = 0;
+	tx_flow_byte = 0;
+	rx_overruns = 0;
+	
+	// Clear link health counters
+	frame_errors = 0;
+	data_overruns = 0;
+	parity_errors = 0;
+	tx_queue_full = 0;
+	acks_coalesced = 0;
+	rx_bytes = 0;
+	tx_bytes = 0;
+	rx_peak = 0;
+	link_stats_next = link_stats_fields;
+	reset_log_next = reset_log_fields;
 }
 
 
@@ -154,9 +260,8 @@ void init_USART_driver_IO()
 *------------------------------------------------------------------------*/
 void init_USART_driver_mem()
 {
-	#define none 0xFF
-	// Initialize transmitter's FSM to neutral state and number of remaining transmits to 0.
-	transmitter_status = none;
-	OK_transmits_left = 0;
-	R_transmits_left = 0;
+	// Empty transmit queue
+	tx_head = 0;
+	tx_tail = 0;
+	acks_pending = 0;
 }
\ No newline at end of file
@@ -13,14 +13,138 @@
 #define PROGRAM_H_
 	
 	#define F_CPU 10000000
+	// USART baud rate profile: 9600, 38400, 115200, 250000, 500000 or 1000000.
+	// 115200 and 250000 use U2X at 10 MHz, 500000 and 1000000 need an 8 or 16 MHz clock.
 	#define BAUD 9600
+	#include "../../../common/baud_setup.h"
+	
+	#include "../../../common/timer_setup.h"
+	
+	// Timer0 period, time each 7 segment stays lit
+	#define refresh_us 2000
+	// Compare register value and prescaler bits for timer0
+	#define OCR_value timer_compare( refresh_us, timer_8bit )
+	#define timer0_prescaler timer_cs_bits( refresh_us, timer_8bit )
+	#if timer_error( refresh_us, timer_8bit ) > timer_tolerance
+		#error "Timer0 can't make the refresh period with this F_CPU"
+	#endif
 	
-	// Compare register value
-	#define OCR_value 77
 	// 1 data for each 7 segment
 	#define num_of_data 8
+	// Digit index wraps with a mask, number of digits must be a power of 2
+	#if ( num_of_data & ( num_of_data - 1 ) ) != 0
+		#error "num_of_data must be a power of 2"
+	#endif
+	
+	// Segments encoding of an empty 7 segment
+	#define blank_segments 0xFF
+	
+	// Use the naked assembly refresh ISR of 7_segment_refresh.S instead of the C one (0/1)
+	#ifndef refresh_isr_asm
+		#define refresh_isr_asm 0
+	#endif
+	
+	// Receiver's ring buffer, frames wait here for the parser of the main loop.
+	// Power of 2, indexes wrap with a mask.
+	#define rx_buffer_size 16
+	#if ( rx_buffer_size & ( rx_buffer_size - 1 ) ) != 0
+		#error "rx_buffer_size must be a power of 2"
+	#endif
+	
+	// Transmit queue. Power of 2, indexes wrap with a mask.
+	#define tx_buffer_size 32
+	#if ( tx_buffer_size & ( tx_buffer_size - 1 ) ) != 0
+		#error "tx_buffer_size must be a power of 2"
+	#endif
+	
+	// Acks that wait for room in the transmit queue are merged in one "OK n"
+	// response. 0 sends an "OK" for every message.
+	#define ack_coalescing 1
+	
+	// Link statistics, sent as "H <fields>\r\n" in this order after an H message.
+	// Error counters stop at 65535, byte totals wrap.
+	#define stat_frame_errors 0 // Frames with a stop bit error (FE), dropped
+	#define stat_data_overruns 1 // Frames lost before UDR was read (DOR)
+	#define stat_parity_errors 2 // Frames with a parity error (PE), dropped
+	#define stat_rx_overruns 3 // Frames lost because the ring buffer was full
+	#define stat_tx_queue_full 4 // Responses lost because the transmit queue was full
+	#define stat_acks_coalesced 5 // Acks merged in an "OK n"
+	#define stat_rx_bytes 6
+	#define stat_tx_bytes 7
+	#define stat_rx_peak 8 // Most frames waiting in the ring buffer
+	#define link_stats_fields 9
+	
+	// Receive flow control. The host is stopped when rx_high_watermark frames wait in
+	// the ring buffer, and restarted when the parser gets them down to rx_low_watermark.
+	// XON/XOFF bytes go out before the queued responses. RTS is an output, high while
+	// the host must stop, for hosts that use CTS.
+	#define flow_xon_xoff 1
+	#define flow_rts 0
+	#define XON 0x11
+	#define XOFF 0x13
+	#define rts_port PORTD
+	#define rts_DDR DDRD
+	#define rts_pin PD2
+	#define rx_high_watermark ( rx_buffer_size * 3 / 4 )
+	#define rx_low_watermark ( rx_buffer_size / 4 )
+	#if rx_low_watermark >= rx_high_watermark || rx_high_watermark >= rx_buffer_size
+		#error "Watermarks must be low < high < rx_buffer_size"
+	#endif
+
+	// Glyph codes, indexes of segments_encoding. 0x00 - 0x0F are the hex digits,
+	// the rest are shown by lowercase letters and symbols, see ascii_segments
+	#define glyph_blank 0x10
+	#define glyph_minus 0x11
+	#define glyph_underscore 0x12
+	#define glyph_H 0x13
+	#define glyph_J 0x14
+	#define glyph_L 0x15
+	#define glyph_n 0x16
+	#define glyph_o 0x17
+	#define glyph_P 0x18
+	#define glyph_r 0x19
+	#define glyph_t 0x1A
+	#define glyph_U 0x1B
+	#define glyph_y 0x1C
 	
 	// enable/disable warm start (0/1)
 	#define warm_start_enable 1
+	
+	// State kept by a warm start. crc is the CRC-CCITT (util/crc16.h) of the fields
+	// before it, refreshed by warm_state_commit after every change. A warm start
+	// keeps the state only when the CRC matches.
+	// 7_segment_refresh.S reads data and head by their offsets, keep them first.
+	#ifndef __ASSEMBLER__
+		struct warm_state
+		{
+			unsigned char data[num_of_data]; // Segments of the 7 segment display, encoded
+			unsigned char head; // Ring buffer slot of the rightmost digit (AN0)
+			unsigned int crc;
+		};
+	#endif
+	#define warm_crc_seed 0xFFFF
+	
+	// Reset telemetry in EEPROM, see reset_log.c. A ring of reset_log_records records
+	// from reset_log_address, 12 bytes each. Power of 2, slots wrap with a mask.
+	#define reset_log_records 16
+	#if ( reset_log_records & ( reset_log_records - 1 ) ) != 0
+		#error "reset_log_records must be a power of 2"
+	#endif
+	#define reset_log_address 0
+	// Causes counted by a record, indexed by their MCUCSR bit: PORF, EXTRF, BORF, WDRF
+	#define reset_causes 4
+	#ifndef __ASSEMBLER__
+		struct reset_record
+		{
+			unsigned int sequence; // Resets logged, the newest record has the highest
+			unsigned char flags; // MCUCSR reset flags of this reset
+			unsigned int counts[reset_causes]; // Resets of every cause so far
+			unsigned char crc; // CRC-8 (util/crc16.h) of the fields before it
+		};
+	#endif
+	// Erased (0xFF) and cleared records don't match a CRC from this seed
+	#define reset_log_crc_seed 0xFF
+	// Fields of the E response: resets, counts and the flags of the resets in the ring
+	#define reset_log_fields ( 1 + reset_causes + reset_log_records )
 
 #endif /* PROGRAM_H_ */
\ No newline at end of file
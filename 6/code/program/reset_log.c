@@ -0,0 +1,141 @@
+/*
+ * reset_log.c
+ *
+ * Reset telemetry in EEPROM. Every reset adds a record with its MCUCSR flags and
+ * the cumulative count of every cause to a ring of reset_log_records slots, over
+ * the oldest one. Each slot is written once every reset_log_records resets.
+ * The newest record is the valid one with the highest sequence number, a record
+ * torn by a reset while it was written fails its CRC and the previous one is used.
+ *
+ * The ring is read once after the boot, the record is written byte by byte by
+ * the EE_RDY ISR. The start isn't delayed by the 8.5 ms of every EEPROM write.
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ * Developed with AtmelStudio 7.0.129
+ */
+
+#include <avr/io.h> // Required for the I/O registers macros
+#include <avr/interrupt.h> // Required for the ISR macro
+#include <avr/eeprom.h> // Required for eeprom_read_block
+#include <util/crc16.h> // Required for _crc8_ccitt_update
+#include <stddef.h> // Required for offsetof
+#include <string.h> // Required for memset
+#include "program.h"
+
+// Record written by the EE_RDY ISR, its slot and the bytes written so far
+extern volatile struct reset_record reset_log_newest;
+extern volatile unsigned char reset_log_slot;
+extern volatile unsigned char reset_log_written;
+extern unsigned char reset_log_history[reset_log_records];
+extern unsigned char reset_log_history_length;
+
+// EEPROM address of a slot of the ring
+#define slot_address( slot ) ( reset_log_address + ( slot ) * sizeof( struct reset_record ) )
+
+
+/*-------------------------------------------------------------------------
+* CRC of a record, all fields before crc.
+*------------------------------------------------------------------------*/
+static unsigned char record_crc( const struct reset_record * record )
+{
+	const unsigned char * bytes = (const unsigned char *) record;
+	unsigned char crc = reset_log_crc_seed;
+	for( unsigned char i = 0 ; i < offsetof( struct reset_record, crc ) ; i++ )
+		crc = _crc8_ccitt_update( crc, bytes[i] );
+	return crc;
+}
+
+
+/*-------------------------------------------------------------------------
+* Read the record of a slot. Returns 1 if it matches its CRC.
+*------------------------------------------------------------------------*/
+static unsigned char read_record( unsigned char slot, struct reset_record * record )
+{
+	eeprom_read_block( record, (const void *) slot_address( slot ), sizeof( struct reset_record ) );
+	return record->crc == record_crc( record );
+}
+
+
+/*-------------------------------------------------------------------------
+* Find the newest record, count the reset in a new one and start the EE_RDY
+* ISR that writes it. Builds the history of the resets for the E response.
+* Called once, after the boot. reset_source is MCUCSR of the reset.
+*------------------------------------------------------------------------*/
+void reset_log_record( unsigned char reset_source )
+{
+	unsigned char flags = reset_source & ( ( 1 << JTRF ) | ( 1 << WDRF ) | ( 1 << BORF ) | ( 1 << EXTRF ) | ( 1 << PORF ) );
+	struct reset_record record;
+	struct reset_record newest;
+	unsigned char newest_slot = reset_log_records - 1; // An empty ring starts at slot 0
+	unsigned char found = 0;
+
+	// Sequence numbers wrap, the newer one is ahead by less than half the range
+	for( unsigned char slot = 0 ; slot < reset_log_records ; slot++ )
+		if( read_record( slot, &record ) && ( !found || (int) ( record.sequence - newest.sequence ) > 0 ) )
+		{
+			newest = record;
+			newest_slot = slot;
+			found = 1;
+		}
+	if( !found )
+		memset( &newest, 0, sizeof( newest ) );
+
+	// History, newest first. Older records are in the slots before, while their sequence numbers follow.
+	reset_log_history[0] = flags;
+	reset_log_history_length = 1;
+	if( found )
+	{
+		reset_log_history[reset_log_history_length++] = newest.flags;
+		// The new record goes over the oldest one, it isn't history
+		for( unsigned char back = 1 ; back < reset_log_records - 1 ; back++ )
+		{
+			unsigned char slot = ( newest_slot - back ) & ( reset_log_records - 1 );
+			if( !read_record( slot, &record ) || record.sequence != (unsigned int) ( newest.sequence - back ) )
+				break;
+			reset_log_history[reset_log_history_length++] = record.flags;
+		}
+	}
+
+	// New record, every flag is counted. Counts stop at 65535.
+	newest.sequence++;
+	newest.flags = flags;
+	for( unsigned char cause = 0 ; cause < reset_causes ; cause++ )
+		if( ( flags & ( 1 << cause ) ) && newest.counts[cause] != 0xFFFF )
+			newest.counts[cause]++;
+	newest.crc = record_crc( &newest );
+
+	reset_log_newest = newest;
+	reset_log_slot = ( newest_slot + 1 ) & ( reset_log_records - 1 );
+	reset_log_written = 0;
+	EECR |= ( 1 << EERIE );
+}
+
+
+//--------------------------------------------------------------------
+// Interrupt service routine for EEPROM ready.
+// Writes the next byte of the new record. EE_RDY stays set while the EEPROM
+// is idle, the ISR runs again at once after a byte that didn't need a write.
+//--------------------------------------------------------------------
+ISR( EE_RDY_vect )
+{
+	unsigned char index = reset_log_written;
+	if( index == sizeof( struct reset_record ) )
+	{
+		// Record written
+		EECR &= ~( 1 << EERIE );
+		return;
+	}
+	reset_log_written = index + 1;
+	unsigned char byte = ( (volatile unsigned char *) &reset_log_newest )[index];
+
+	// An unchanged byte isn't written, cells wear only when they change
+	EEAR = slot_address( reset_log_slot ) + index;
+	EECR |= ( 1 << EERE );
+	if( EEDR == byte )
+		return;
+	EEDR = byte;
+	// EEWE within 4 cycles of EEMWE, interrupts are disabled in the ISR
+	EECR |= ( 1 << EEMWE );
+	EECR |= ( 1 << EEWE );
+}
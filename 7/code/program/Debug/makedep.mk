@@ -4,6 +4,8 @@
 
 7_segment_driver.c
 
+7_segment_refresh.S
+
 program.c
 
 processes.c
@@ -12,27 +12,145 @@
 #include "program.h"
 #include <avr/io.h> // Required for the I/O registers macros
 #include <avr/interrupt.h> // Required for the ISR macro
+#include <avr/pgmspace.h> // Required for PSTR and pgm_read_byte
+#include <util/atomic.h> // Required for ATOMIC_BLOCK
+#include <stdlib.h> // Required for ultoa
+#include <string.h> // Required for strlen and strcat
+#include "../../../common/usart_input.h"
 
-extern unsigned char data[8];
+extern unsigned char segments_data[num_of_data];
+extern unsigned char segments_head;
+unsigned char ascii_segments( unsigned char frame );
 extern unsigned char receiver_status;
-extern unsigned char transmitter_status;
-extern unsigned char OK_transmits_left;
 extern unsigned char scheduler_control;
+// Transmit queue, filled by USART_send and emptied by the UDRE ISR
+extern volatile unsigned char tx_buffer[tx_buffer_size];
+extern volatile unsigned char tx_head;
+extern volatile unsigned char tx_tail;
+extern unsigned long acks_pending;
+// Ring buffer of the receiver. Volatile, the ISR and the parser share it without locking.
+extern volatile unsigned char rx_buffer[rx_buffer_size];
+extern volatile unsigned char rx_head;
+extern volatile unsigned char rx_tail;
+extern volatile unsigned int rx_overruns;
+// Link health counters
+extern unsigned int frame_errors;
+extern unsigned int data_overruns;
+extern unsigned int parity_errors;
+extern unsigned int tx_queue_full;
+extern unsigned long acks_coalesced;
+extern unsigned long rx_bytes;
+extern unsigned long tx_bytes;
+extern unsigned char rx_peak;
+extern unsigned long link_stats[link_stats_fields];
+extern unsigned char link_stats_next;
+extern volatile unsigned char rx_throttled;
+extern volatile unsigned char tx_flow_byte;
+
+unsigned char USART_send_string( const char * string );
+unsigned char USART_send_string_P( const char * string );
+
+// Counters stop at their maximum instead of wrapping to 0
+#define count_saturated( counter ) do { if( counter != 0xFFFF ) counter++; } while( 0 )
+
+
+/*-------------------------------------------------------------------------
+* Stop (1) or restart (0) the host. RTS changes at once, XON/XOFF is sent
+* before the queued responses. Runs with interrupts disabled.
+*------------------------------------------------------------------------*/
+static inline void throttle( unsigned char stop )
+{
+	rx_throttled = stop;
+	#if flow_rts
+		if( stop )
+			rts_port |= ( 1 << rts_pin );
+		else
+			rts_port &= ~( 1 << rts_pin );
+	#endif
+	#if flow_xon_xoff
+		// An XOFF that isn't sent yet is replaced, the host never stopped
+		tx_flow_byte = stop ? XOFF : XON;
+		UCSRB |= ( 1 << UDRIE );
+	#endif
+}
 
 
 //--------------------------------------------------------------------
 // Interrupt service routine for USART receive completed.
-// Communication is errorless and previous/next inputs/states are irrelevant so a state-machine isn't needed.
-// Only the current input is needed to take the appropriate action.
+// Only stores the frame in the ring buffer, USART_parse does the rest in the main loop.
+// Display refresh isn't blocked while a message is processed.
 //--------------------------------------------------------------------
 ISR( USART_RXC_vect )
 {
-	// Receive frame
-	unsigned char received_frame = UDR;
-	// for debug
-	received_frame = UDR;
-	asm( "mov %0 , r20" : "=r" ( received_frame ) );
+	// Receive frame, from UDR or the stimuli file, and its error flags
+	unsigned char errors;
+	unsigned char received_frame = usart_input( &errors );
+	rx_bytes++;
 	
+	// Error flags are almost always clear, one test in the common case
+	if( errors )
+	{
+		if( errors & ( 1 << DOR ) )
+			count_saturated( data_overruns ); // Frames before this one were lost
+		if( errors & ( 1 << FE ) )
+			count_saturated( frame_errors );
+		if( errors & ( 1 << PE ) )
+			count_saturated( parity_errors );
+		// Frame is corrupt
+		if( errors & ( ( 1 << FE ) | ( 1 << PE ) ) )
+			return;
+	}
+	
+	// Only the ISR writes the head and only the parser writes the tail. No locking needed.
+	unsigned char head = rx_head;
+	unsigned char next = ( head + 1 ) & ( rx_buffer_size - 1 );
+	if( next == rx_tail )
+		count_saturated( rx_overruns ); // Buffer full, frame is lost
+	else
+	{
+		rx_buffer[head] = received_frame;
+		rx_head = next;
+		#if flow_xon_xoff || flow_rts
+			// Stop the host before the ring buffer fills
+			if( !rx_throttled && ( ( next - rx_tail ) & ( rx_buffer_size - 1 ) ) >= rx_high_watermark )
+				throttle( 1 );
+		#endif
+	}
+}
+
+
+/*-------------------------------------------------------------------------
+* Copy the link counters for the H response. Interrupts update them, the copy
+* is taken at once so the fields agree with each other.
+* A request while the previous response is being sent is ignored.
+*------------------------------------------------------------------------*/
+static void snapshot_link_stats()
+{
+	if( link_stats_next < link_stats_fields )
+		return;
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		link_stats[stat_frame_errors] = frame_errors;
+		link_stats[stat_data_overruns] = data_overruns;
+		link_stats[stat_parity_errors] = parity_errors;
+		link_stats[stat_rx_overruns] = rx_overruns;
+		link_stats[stat_tx_queue_full] = tx_queue_full;
+		link_stats[stat_acks_coalesced] = acks_coalesced;
+		link_stats[stat_rx_bytes] = rx_bytes;
+		link_stats[stat_tx_bytes] = tx_bytes;
+		link_stats[stat_rx_peak] = rx_peak;
+	}
+	link_stats_next = 0;
+}
+
+
+/*-------------------------------------------------------------------------
+* Take the action of a received frame. Runs in the main loop.
+* Communication is errorless and previous/next inputs/states are irrelevant so a state-machine isn't needed.
+* Only the current input is needed to take the appropriate action.
+*------------------------------------------------------------------------*/
+static void parse_frame( unsigned char received_frame )
+{
 	if( received_frame == 'S' )
 		receiver_status = proc_enable_message; // Set type of message
 		
@@ -41,14 +159,17 @@ ISR( USART_RXC_vect )
 		
 	else if( received_frame == 'C' )
 		for( unsigned char i = 0 ; i < num_of_data ; i++ )
-			data[i] = 0x0A; // Clear data
+			segments_data[i] = blank_segments; // Clear data
 			
 	else if( received_frame == 'N' )
 	{
 		receiver_status = display_message; // Set type of message
 		for( unsigned char i = 0 ; i < num_of_data ; i++ )
-			data[i] = 0x0A; // Clear data
+			segments_data[i] = blank_segments; // Clear data
 	}
+	else if( received_frame == 'H' )
+		snapshot_link_stats(); // Link statistics for the host
+	
 	else if( received_frame == 'A' )
 		return; // Do nothing
 		
@@ -62,22 +183,21 @@ ISR( USART_RXC_vect )
 	{
 		// Message ended
 		receiver_status = none;
-		 // Increase pending responses counter
-		OK_transmits_left++;
-		// Enable transmitter interrupts to start the response. If it is already enabled, nothing changes.
-		UCSRB |= ( 1 << UDRIE ); // breakpoint here to check memory after message
+		// Response for the host, sent by send_acks
+		acks_pending++; // breakpoint here to check memory after message
 	}
-	else // Frame is a number
+	else // Frame is a number, or a letter or symbol of ascii_segments
 	{
 		unsigned char number = received_frame & ascii_to_bcd_mask;
 		// Treatment of a number depends on the type of its message
 		if ( receiver_status == display_message )
 		{	
-			// Moves all data one position forward. Top element gets discarded.
-			for( unsigned char i = num_of_data - 2 ; i != 0xFF ; i-- ) // last element is in position 0x00
-			data[ i + 1 ] = data[i];
-			// Save new data. Top half byte cleared, ascii -> bcd
-			data[0] = number;
+			// Moving the head back moves all data one position forward, whatever the number of digits.
+			// Top element is the one before the head and gets overwritten.
+			unsigned char head = ( segments_head - 1 ) & ( num_of_data - 1 );
+			// Save new data encoded, so the 7 segment driver can output it directly.
+			segments_data[head] = ascii_segments( received_frame );
+			segments_head = head;
 		}
 		else if( receiver_status == proc_enable_message )
 			// Enable process
@@ -90,54 +210,213 @@ ISR( USART_RXC_vect )
 }
 
 
-//--------------------------------------------------------------------
-// Interrupt service routine for USART transmitter completed.
-// FSM is one way (see report), input is irrelevant. Only current state is needed to compute next state.
-//--------------------------------------------------------------------
-ISR( USART_UDRE_vect )
+/*-------------------------------------------------------------------------
+* Free bytes of the transmit queue. Only the UDRE ISR can make it bigger.
+*------------------------------------------------------------------------*/
+static unsigned char tx_space()
 {
-	if( transmitter_status == none )
-	{
-		// Decrease pending responses
-		OK_transmits_left--;
-		// Change State
-		transmitter_status = 'O';
-		// Send character
-		UDR = 'O';
-		// Transmitter's UDR is write-only and can't be read by the simulator.
-		// TCNT2 is used for logging.
-		TCNT2 = 'O';
-	}
-	else if( transmitter_status == 'O' )
-	{
-		// Change State
-		transmitter_status = 'K';
-		// Send character
-		UDR = 'K';
-		TCNT2 = 'K';
-	}
-	else if( transmitter_status == 'K' )
+	return ( tx_tail - tx_head - 1 ) & ( tx_buffer_size - 1 );
+}
+
+
+/*-------------------------------------------------------------------------
+* Send the H response, "H" and the counters copied by snapshot_link_stats.
+* The line is longer than the transmit queue, a field is queued when it fits.
+* Returns 1 while fields are left.
+*------------------------------------------------------------------------*/
+static unsigned char send_link_stats()
+{
+	while( link_stats_next < link_stats_fields )
 	{
-		// Change State
-		transmitter_status = 0x0D; // CR
-		// Send character
-		UDR = 0x0D;
-		TCNT2 = 0x0D;
+		// "H " + 10 digits of an unsigned long + "\r\n"
+		char field[16];
+		char * text = field;
+		if( link_stats_next == 0 )
+			*text++ = 'H';
+		*text++ = ' ';
+		ultoa( link_stats[link_stats_next], text, 10 );
+		if( link_stats_next == link_stats_fields - 1 )
+			strcat( text, "\r\n" );
+		// Waiting for room isn't a full queue, checked before queue counts it
+		if( strlen( field ) > tx_space() )
+			return 1;
+		USART_send_string( field );
+		link_stats_next++;
 	}
-	else if( transmitter_status == 0x0D )
+	return 0;
+}
+
+
+/*-------------------------------------------------------------------------
+* Send the responses of the ended messages. An ack waits here while the
+* transmit queue is busy, it isn't lost when the queue is full.
+* With ack_coalescing, acks are sent only when the queue is empty, all pending
+* ones in one "OK n" ("OK" for one). Responses never fall behind the messages
+* and the host adds up the counts to know how many messages were accepted.
+*------------------------------------------------------------------------*/
+static void send_acks()
+{
+	if( acks_pending == 0 )
+		return;
+	#if ack_coalescing
+		// Transmitter is busy, next acks get merged
+		if( tx_head != tx_tail )
+			return;
+		if( acks_pending == 1 )
+			USART_send_string_P( PSTR( "OK\r\n" ) );
+		else
+		{
+			// "OK " + 10 digits of an unsigned long + "\r\n"
+			char response[16] = "OK ";
+			ultoa( acks_pending, &response[3], 10 );
+			strcat( response, "\r\n" );
+			USART_send_string( response );
+			acks_coalesced += acks_pending - 1;
+		}
+		acks_pending = 0;
+	#else
+		while( acks_pending != 0 && tx_space() >= 4 )
+		{
+			USART_send_string_P( PSTR( "OK\r\n" ) );
+			acks_pending--;
+		}
+	#endif
+}
+
+
+/*-------------------------------------------------------------------------
+* Parse the frames stored by the receive ISR. Called from the main loop.
+*------------------------------------------------------------------------*/
+void USART_parse()
+{
+	// Peak backlog of the receiver
+	unsigned char backlog = ( rx_head - rx_tail ) & ( rx_buffer_size - 1 );
+	if( backlog > rx_peak )
+		rx_peak = backlog;
+	
+	while( rx_tail != rx_head )
 	{
-		// Change State
-		transmitter_status = 0x0A; // LF
-		// Send character
-		UDR = 0x0A;
-		TCNT2 = 0x0A;
+		unsigned char tail = rx_tail;
+		parse_frame( rx_buffer[tail] );
+		// Slot is free for the ISR only after the frame is parsed
+		rx_tail = ( tail + 1 ) & ( rx_buffer_size - 1 );
+		#if flow_xon_xoff || flow_rts
+			// Restart the host. Checked again with interrupts disabled, the ISR can stop it in between.
+			if( rx_throttled )
+				ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+					if( ( ( rx_head - rx_tail ) & ( rx_buffer_size - 1 ) ) <= rx_low_watermark )
+						throttle( 0 );
+		#endif
 	}
-	else if( transmitter_status == 0x0A ) // LF
+	// The H response goes out whole before the next acks
+	if( !send_link_stats() )
+		send_acks();
+}
+
+
+/*-------------------------------------------------------------------------
+* Returns 1 while the receive ISR stored frames that aren't parsed yet.
+* Pending responses need no check, the transmitter's interrupts wake the main loop.
+*------------------------------------------------------------------------*/
+unsigned char USART_busy()
+{
+	return rx_tail != rx_head;
+}
+
+
+/*-------------------------------------------------------------------------
+* Copy data to the transmit queue, whole or nothing, and start the transmitter.
+* One atomic block for all the data, producers can be ISRs or the main loop.
+* Returns 0 if the queue can't hold the data.
+*------------------------------------------------------------------------*/
+static unsigned char queue( const char * bytes, unsigned char length, unsigned char program_memory )
+{
+	unsigned char queued = 0;
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
 	{
-		// Change State
-		transmitter_status = none;
-		// If no more transmits required, disable transmitter interrupts.
-		if( OK_transmits_left == 0 )
-			UCSRB &= ~( 1 << UDRIE );
+		unsigned char head = tx_head;
+		// One slot stays empty to tell a full queue from an empty one
+		unsigned char space = ( tx_tail - head - 1 ) & ( tx_buffer_size - 1 );
+		if( length <= space )
+		{
+			for( unsigned char i = 0 ; i < length ; i++ )
+			{
+				tx_buffer[head] = program_memory ? pgm_read_byte( &bytes[i] ) : bytes[i];
+				head = ( head + 1 ) & ( tx_buffer_size - 1 );
+			}
+			tx_head = head;
+			// Start the transmitter. If it is already enabled, nothing changes.
+			if( length != 0 )
+				UCSRB |= ( 1 << UDRIE );
+			queued = 1;
+		}
+		else
+			count_saturated( tx_queue_full );
 	}
+	return queued;
+}
+
+
+/*-------------------------------------------------------------------------
+* Queue a byte for the transmitter. Returns 0 if the queue is full.
+*------------------------------------------------------------------------*/
+unsigned char USART_send( unsigned char byte )
+{
+	return queue( (const char *) &byte, 1, 0 );
+}
+
+
+/*-------------------------------------------------------------------------
+* Queue a string from SRAM for the transmitter. Returns 0 if it doesn't fit.
+*------------------------------------------------------------------------*/
+unsigned char USART_send_string( const char * string )
+{
+	return queue( string, strlen( string ), 0 );
+}
+
+
+/*-------------------------------------------------------------------------
+* Queue a string from program memory for the transmitter, see PSTR.
+* Returns 0 if it doesn't fit.
+*------------------------------------------------------------------------*/
+unsigned char USART_send_string_P( const char * string )
+{
+	return queue( string, strlen_P( string ), 1 );
+}
+
+
+//--------------------------------------------------------------------
+// Interrupt service routine for USART data register empty.
+// Sends the next byte of the transmit queue. Enabled only while the queue isn't empty
+// or a flow control byte waits.
+//--------------------------------------------------------------------
+ISR( USART_UDRE_vect )
+{
+	#if flow_xon_xoff
+		// Flow control goes before the responses
+		unsigned char flow = tx_flow_byte;
+		if( flow )
+		{
+			UDR = flow;
+			TCNT2 = flow;
+			tx_flow_byte = 0;
+			tx_bytes++;
+			if( tx_tail == tx_head )
+				UCSRB &= ~( 1 << UDRIE );
+			return;
+		}
+	#endif
+	unsigned char tail = tx_tail;
+	unsigned char byte = tx_buffer[tail];
+	// Send character
+	UDR = byte;
+	// Transmitter's UDR is write-only and can't be read by the simulator.
+	// TCNT2 is used for logging.
+	TCNT2 = byte;
+	tail = ( tail + 1 ) & ( tx_buffer_size - 1 );
+	tx_tail = tail;
+	tx_bytes++;
+	// Queue is empty, no interrupts while idle
+	if( tail == tx_head )
+		UCSRB &= ~( 1 << UDRIE );
 }
\ No newline at end of file
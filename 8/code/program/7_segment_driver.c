@@ -1,49 +1,241 @@
 ﻿/*
  * 7_segment_driver.c
  *
- * Driver for an 8 digits 7 segment display. Shows data from SRAM.
+ * Driver for a num_of_data digits 7 segment display. Shows data from SRAM.
+ * Outputs on ports A and C, or through a chain of 74HC595 shift registers on the SPI.
+ * The SPI back end uses PB4, PB5, PB7 and the latch pin, port B isn't free for other outputs.
+ * Data are stored already encoded in a ring buffer, so every refresh takes the same time.
+ * Two pages are used. USART driver writes the back page, the front page is shown
+ * and they are swapped at the start of a frame.
  *
  * Created: 10/11/2020
  * Author: Emmanouil Petrakos
  * Developed with AtmelStudio 7.0.129
  */ 
 
+#include "program.h"
 #include <avr/io.h> // Required for the I/O registers macros
 #include <avr/interrupt.h> // Required for the ISR macro
+#include <avr/pgmspace.h> // Required for PROGMEM
 
-extern unsigned char data[8];
-extern unsigned char segments_encoding[11];
+extern unsigned char segments_data[2][num_of_data];
+extern unsigned char segments_head[2];
+extern unsigned char front_page;
+extern unsigned char page_flip_pending;
+extern unsigned char segments_lit[2];
+extern unsigned char segments_dark_ocr[2];
+extern unsigned char digit_index;
+extern unsigned int refresh_calls;
+#if display_backend_spi
+	extern unsigned char spi_bytes_left;
+	extern unsigned char spi_anode_byte;
+	extern unsigned char spi_anode_bits;
+	extern unsigned char spi_segments;
+#endif
 
+// Segments are active low. Bit 7 is segment a, bit 0 is the decimal point.
+#define seg_a ( 1 << 7 )
+#define seg_b ( 1 << 6 )
+#define seg_c ( 1 << 5 )
+#define seg_d ( 1 << 4 )
+#define seg_e ( 1 << 3 )
+#define seg_f ( 1 << 2 )
+#define seg_g ( 1 << 1 )
+#define glyph( segments ) ( (unsigned char) ~( segments ) )
 
+// Encoding of every glyph code. Built by the compiler and read from flash.
+const unsigned char segments_encoding[] PROGMEM =
+{
+	glyph( seg_a | seg_b | seg_c | seg_d | seg_e | seg_f ), // 0
+	glyph( seg_b | seg_c ), // 1
+	glyph( seg_a | seg_b | seg_d | seg_e | seg_g ), // 2
+	glyph( seg_a | seg_b | seg_c | seg_d | seg_g ), // 3
+	glyph( seg_b | seg_c | seg_f | seg_g ), // 4
+	glyph( seg_a | seg_c | seg_d | seg_f | seg_g ), // 5
+	glyph( seg_a | seg_c | seg_d | seg_e | seg_f | seg_g ), // 6
+	glyph( seg_a | seg_b | seg_c ), // 7
+	glyph( seg_a | seg_b | seg_c | seg_d | seg_e | seg_f | seg_g ), // 8
+	glyph( seg_a | seg_b | seg_c | seg_d | seg_f | seg_g ), // 9
+	glyph( seg_a | seg_b | seg_c | seg_e | seg_f | seg_g ), // A
+	glyph( seg_c | seg_d | seg_e | seg_f | seg_g ), // b
+	glyph( seg_a | seg_d | seg_e | seg_f ), // C
+	glyph( seg_b | seg_c | seg_d | seg_e | seg_g ), // d
+	glyph( seg_a | seg_d | seg_e | seg_f | seg_g ), // E
+	glyph( seg_a | seg_e | seg_f | seg_g ), // F
+	glyph( 0 ), // blank
+	glyph( seg_g ), // -
+	glyph( seg_d ), // _
+	glyph( seg_b | seg_c | seg_e | seg_f | seg_g ), // H
+	glyph( seg_b | seg_c | seg_d | seg_e ), // J
+	glyph( seg_d | seg_e | seg_f ), // L
+	glyph( seg_c | seg_e | seg_g ), // n
+	glyph( seg_c | seg_d | seg_e | seg_g ), // o
+	glyph( seg_a | seg_b | seg_e | seg_f | seg_g ), // P
+	glyph( seg_e | seg_g ), // r
+	glyph( seg_d | seg_e | seg_f | seg_g ), // t
+	glyph( seg_b | seg_c | seg_d | seg_e | seg_f ), // U
+	glyph( seg_b | seg_c | seg_d | seg_f | seg_g ) // y
+};
+
+// Glyph codes of the lowercase letters. Capital letters are commands, a - f show
+// the hex digits and the letters without a glyph are blank.
+static const unsigned char letter_glyphs['z' - 'a' + 1] PROGMEM =
+{
+	0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, // a - f
+	glyph_blank, // g
+	glyph_H, // h
+	glyph_blank, // i
+	glyph_J, // j
+	glyph_blank, // k
+	glyph_L, // l
+	glyph_blank, // m
+	glyph_n, // n
+	glyph_o, // o
+	glyph_P, // p
+	glyph_blank, // q
+	glyph_r, // r
+	glyph_blank, // s
+	glyph_t, // t
+	glyph_U, // u
+	glyph_blank, glyph_blank, glyph_blank, // v - x
+	glyph_y, // y
+	glyph_blank // z
+};
+
+
+/*-------------------------------------------------------------------------
+* Segments encoding of a display frame: a digit, a lowercase letter, '-', '_'
+* or space. Other frames keep their low nibble, like the digits.
+*------------------------------------------------------------------------*/
+unsigned char ascii_segments( unsigned char frame )
+{
+	unsigned char code;
+	if( frame >= 'a' && frame <= 'z' )
+		code = pgm_read_byte( &letter_glyphs[frame - 'a'] );
+	else if( frame == '-' )
+		code = glyph_minus;
+	else if( frame == '_' )
+		code = glyph_underscore;
+	else if( frame == ' ' )
+		code = glyph_blank;
+	else
+		code = frame & 0x0F; // ascii -> bcd
+	return pgm_read_byte( &segments_encoding[code] );
+}
+
+
+#if display_backend_spi
+//--------------------------------------------------------------------
+// Start sending the anodes and the segments of a slot to the shift registers.
+// Chain is sent from the last anode byte to the first, segments byte goes last
+// and ends up in the register next to the MCU. SPI interrupt sends the rest.
+//--------------------------------------------------------------------
+static inline void start_shift_register_transfer()
+{
+	spi_bytes_left = anode_bytes;
+	SPDR = ( spi_anode_byte == anode_bytes - 1 ) ? spi_anode_bits : 0x00;
+}
+
+
+//--------------------------------------------------------------------
+// Interrupt service routine for SPI serial transfer complete.
+// Sends the next byte of the chain. After the segments byte, latches all
+// shift registers at once, so anodes and segments change together.
+//--------------------------------------------------------------------
+ISR( SPI_STC_vect )
+{
+	unsigned char left = spi_bytes_left;
+	if( left == 0 )
+	{
+		// Rising edge on RCK
+		latch_port |= ( 1 << latch_pin );
+		latch_port &= ~( 1 << latch_pin );
+		return;
+	}
+	left--;
+	spi_bytes_left = left;
+	if( left == 0 )
+		SPDR = spi_segments;
+	else // Only one anode byte has a set bit
+		SPDR = ( spi_anode_byte == left - 1 ) ? spi_anode_bits : 0x00;
+}
+#endif
+
+
+#if !refresh_isr_asm
 //--------------------------------------------------------------------
 // Interrupt service routine for timer/counter0 compare match mode.
-// Controls 7 segments outputs.
+// Controls 7 segments outputs. With adaptive refresh, only lit digits get a slot
+// and one dark slot covers all the blank ones.
+// 7_segment_refresh.S has the same routine in assembly.
 //--------------------------------------------------------------------
 ISR( TIMER0_COMP_vect )
 {
-	// Show nothing
-	PORTA = 0xFF;
+	#if !display_backend_spi
+		// Show nothing
+		PORTA = 0xFF;
+	#endif
+	
+	#if refresh_statistics
+		refresh_calls++;
+	#endif
 	
-	// Ring counter
-	// local variable in order to minimize access to I/O ports
-	unsigned char ring_counter = PORTC;
-	ring_counter = ( ring_counter >> 7 ) | ( ring_counter << 1 );
-	PORTC = ring_counter;
+	// local variables in order to minimize memory accesses
+	unsigned char index = digit_index + 1;
+	unsigned char page = front_page;
+	unsigned char lit = adaptive_refresh ? segments_lit[page] : num_of_data;
 	
-	// Get data based on ring counter. This block replaces assembly's ring_to_bcd
-	unsigned char shift_counter = 0;
-	while(1)
+	// Frame ends after the last digit, or after the dark slot of the blank digits.
+	if( index > lit || index == num_of_data )
 	{
-		ring_counter >>= 1;
-		if( ring_counter != 0 )
-			shift_counter++;
-		else
-			break;
+		// Frame starts at AN0. Show a completed message from here on, so no frame mixes two messages.
+		index = 0;
+		if( page_flip_pending )
+		{
+			page ^= 1;
+			front_page = page;
+			page_flip_pending = 0;
+			lit = adaptive_refresh ? segments_lit[page] : num_of_data;
+		}
 	}
+	digit_index = index;
 	
-	//  Read from memory.
-	unsigned char bcd_number = data[shift_counter];
-
-	// Out to port. Replaces assembly's BCD_to_7_segment_Decoder and out
-	PORTA = segments_encoding[bcd_number];
-} // breakpoint here to check 7 segment ports
\ No newline at end of file
+	if( adaptive_refresh && index == lit )
+	{
+		// Dark slot. Lasts as long as the slots of all blank digits together.
+		#if display_backend_spi
+			spi_anode_bits = 0x00;
+			spi_segments = blank_segments;
+			start_shift_register_transfer();
+		#else
+			PORTC = 0x00;
+		#endif
+		TCCR0 = dark_slot_prescaler | ( 1 << WGM01 );
+		OCR0 = segments_dark_ocr[page];
+		return;
+	}
+	if( adaptive_refresh && index == 0 )
+	{
+		// Previous frame may have ended with a dark slot
+		TCCR0 = digit_slot_prescaler | ( 1 << WGM01 );
+		OCR0 = OCR_value;
+	}
+	
+	// Data are already encoded by the USART driver.
+	// AN0 shows the head of the ring buffer, the rest of the digits follow it.
+	unsigned char segments = segments_data[page][ ( segments_head[page] + index ) & ( num_of_data - 1 ) ];
+	
+	#if display_backend_spi
+		// Ring counter inside the anode byte of the digit. Cost doesn't depend on the number of digits.
+		spi_anode_byte = index >> 3;
+		spi_anode_bits = ( index & 0x07 ) == 0 ? 0x01 : spi_anode_bits << 1;
+		spi_segments = segments;
+		start_shift_register_transfer();
+	#else
+		// Ring counter. Digit index replaces assembly's ring_to_bcd and the shift loop.
+		PORTC = index == 0 ? 0x01 : PORTC << 1;
+		// Out to port
+		PORTA = segments;
+	#endif
+} // breakpoint here to check 7 segment ports
+#endif
\ No newline at end of file
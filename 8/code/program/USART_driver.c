@@ -2,6 +2,7 @@
  * USART_driver.c
  *
  * Driver for the USART. Controls the data in SRAM for the 7 segment display.
+ * Messages are written in the back page, which is shown after the message ends.
  * Transmits a response after every incoming message.
  *
  * Created: 10/11/2020
@@ -12,133 +13,676 @@
 #include "program.h"
 #include <avr/io.h> // Required for the I/O registers macros
 #include <avr/interrupt.h> // Required for the ISR macro
+#include <avr/pgmspace.h> // Required for pgm_read_byte and PSTR
+#include <util/atomic.h> // Required for ATOMIC_BLOCK
+#include <util/crc16.h> // Required for _crc8_ccitt_update
+#include <stdlib.h> // Required for ultoa
+#include <string.h> // Required for strlen and strcat
+#include "../../../common/usart_input.h"
 
-extern unsigned char data[8];
+extern unsigned char segments_data[2][num_of_data];
+extern unsigned char segments_head[2];
+extern unsigned char segments_lit[2];
+extern unsigned char segments_dark_ocr[2];
+extern unsigned char front_page;
+extern unsigned char page_flip_pending;
+extern const unsigned char segments_encoding[] PROGMEM;
+unsigned char ascii_segments( unsigned char frame );
 extern unsigned char receiver_status;
-extern unsigned char transmitter_status;
-extern unsigned char OK_transmits_left;
-extern unsigned char scheduler_control;
+extern unsigned char process_number;
+extern unsigned char page_written;
+extern unsigned char binary_type;
+extern unsigned char binary_length;
+extern unsigned char binary_count;
+extern unsigned char binary_crc;
+extern unsigned char binary_payload[binary_max_payload];
+// Transmit queue, filled by USART_send and emptied by the UDRE ISR
+extern volatile unsigned char tx_buffer[tx_buffer_size];
+extern volatile unsigned char tx_head;
+extern volatile unsigned char tx_tail;
+extern unsigned long acks_pending;
+// Ring buffer of the receiver. Volatile, the ISR and the parser share it without locking.
+extern volatile unsigned char rx_buffer[rx_buffer_size];
+extern volatile unsigned char rx_head;
+extern volatile unsigned char rx_tail;
+extern volatile unsigned int rx_overruns;
+// Link health counters
+extern unsigned int frame_errors;
+extern unsigned int data_overruns;
+extern unsigned int parity_errors;
+extern unsigned int tx_queue_full;
+extern unsigned long acks_coalesced;
+extern unsigned long rx_bytes;
+extern unsigned long tx_bytes;
+extern unsigned char rx_peak;
+extern unsigned long link_stats[link_stats_fields];
+extern unsigned char link_stats_next;
+extern volatile unsigned char rx_throttled;
+extern volatile unsigned char tx_flow_byte;
+#if multidrop
+	extern volatile unsigned char tx_address_due;
+#endif
+
+unsigned char USART_send( unsigned char byte );
+unsigned char USART_send_string( const char * string );
+unsigned char USART_send_string_P( const char * string );
+void scheduler_enable( unsigned char process, unsigned char enable );
+
+// Counters stop at their maximum instead of wrapping to 0
+#define count_saturated( counter ) do { if( counter != 0xFFFF ) counter++; } while( 0 )
+
+
+/*-------------------------------------------------------------------------
+* Stop (1) or restart (0) the host. RTS changes at once, XON/XOFF is sent
+* before the queued responses. Runs with interrupts disabled.
+*------------------------------------------------------------------------*/
+static inline void throttle( unsigned char stop )
+{
+	rx_throttled = stop;
+	#if flow_rts
+		if( stop )
+			rts_port |= ( 1 << rts_pin );
+		else
+			rts_port &= ~( 1 << rts_pin );
+	#endif
+	#if flow_xon_xoff
+		// An XOFF that isn't sent yet is replaced, the host never stopped
+		tx_flow_byte = stop ? XOFF : XON;
+		UCSRB |= ( 1 << UDRIE );
+	#endif
+}
+
+
+/*-------------------------------------------------------------------------
+* Clear the back page. A completed message that waits for its frame is
+* replaced by the new one, so the flip is canceled.
+*------------------------------------------------------------------------*/
+static void clear_back_page()
+{
+	// Refresh ISR flips only when a flip is pending. After this, front_page
+	// stays the same until the next message ends.
+	page_flip_pending = 0;
+	unsigned char page = front_page ^ 1;
+	for( unsigned char i = 0 ; i < num_of_data ; i++ )
+		segments_data[page][i] = blank_segments; // Clear data
+	segments_head[page] = 0;
+	segments_lit[page] = 0;
+	segments_dark_ocr[page] = dark_slot_ocr( 0 );
+	page_written = 1;
+}
 
 
 /*-------------------------------------------------------------------------
 * Interrupt service routine for USART receive completed.
-* Communication is errorless. No error-find/solve code is needed.
-* Treatment of number frames depends on the start of the message. Memory is needed.
-* For any other frame, only current input is needed to take the appropriate action.
+* Only stores the frame in the ring buffer, USART_parse does the rest in the main loop.
+* Display refresh isn't blocked while a message is processed.
 *------------------------------------------------------------------------*/
 ISR( USART_RXC_vect )
 {
-	// Receive frame
-	unsigned char received_frame = UDR;
-	// for debug
-	received_frame = UDR;
-	asm( "mov %0 , r20" : "=r" ( received_frame ) );
+	// Receive frame, from UDR or the stimuli file, and its error flags
+	unsigned char errors;
+	#if multidrop
+		unsigned char address_frame;
+		unsigned char received_frame = usart_input_9bit( &errors, &address_frame );
+	#else
+		unsigned char received_frame = usart_input( &errors );
+	#endif
+	rx_bytes++;
 	
-	if( received_frame == 'S' )
-		receiver_status = proc_enable_message; // Set type of message
-		
-	else if( received_frame == 'Q' )
-		receiver_status = proc_disable_message; // Set type of message
-		
-	else if( received_frame == 'C' )
-		for( unsigned char i = 0 ; i < num_of_data ; i++ )
-			data[i] = 0x0A; // Clear data
-			
-	else if( received_frame == 'N' )
+	// Error flags are almost always clear, one test in the common case
+	if( errors )
 	{
-		receiver_status = display_message; // Set type of message
+		if( errors & ( 1 << DOR ) )
+			count_saturated( data_overruns ); // Frames before this one were lost
+		if( errors & ( 1 << FE ) )
+			count_saturated( frame_errors );
+		if( errors & ( 1 << PE ) )
+			count_saturated( parity_errors );
+		// Frame is corrupt
+		if( errors & ( ( 1 << FE ) | ( 1 << PE ) ) )
+			return;
+	}
+	
+	#if multidrop
+		// Address frame. Data frames for other boards don't reach the ISR.
+		// FE, DOR and PE are written 0 and TXC isn't cleared.
+		if( address_frame )
+		{
+			if( received_frame == node_address )
+				UCSRA = UCSRA & ( 1 << U2X );
+			else
+				UCSRA = ( UCSRA & ( 1 << U2X ) ) | ( 1 << MPCM );
+			return;
+		}
+	#endif
+	
+	// Only the ISR writes the head and only the parser writes the tail. No locking needed.
+	unsigned char head = rx_head;
+	unsigned char next = ( head + 1 ) & ( rx_buffer_size - 1 );
+	if( next == rx_tail )
+		count_saturated( rx_overruns ); // Buffer full, frame is lost
+	else
+	{
+		rx_buffer[head] = received_frame;
+		rx_head = next;
+		#if flow_xon_xoff || flow_rts
+			// Stop the host before the ring buffer fills
+			if( !rx_throttled && ( ( next - rx_tail ) & ( rx_buffer_size - 1 ) ) >= rx_high_watermark )
+				throttle( 1 );
+		#endif
+	}
+}
+
+
+/*-------------------------------------------------------------------------
+* Get the back page ready for a binary frame, holding the newest digits.
+* Returns the page.
+*------------------------------------------------------------------------*/
+static unsigned char binary_back_page()
+{
+	unsigned char pending;
+	// Refresh ISR can flip between the read and the clear
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		pending = page_flip_pending;
+		page_flip_pending = 0;
+	}
+	unsigned char page = front_page ^ 1;
+	// A completed page that wasn't shown yet is the newest. Otherwise start from the shown one.
+	if( !pending )
+	{
+		unsigned char front = front_page;
 		for( unsigned char i = 0 ; i < num_of_data ; i++ )
-			data[i] = 0x0A; // Clear data
+			segments_data[page][i] = segments_data[front][i];
+		segments_head[page] = segments_head[front];
+		segments_lit[page] = segments_lit[front];
+		segments_dark_ocr[page] = segments_dark_ocr[front];
 	}
-	else if( received_frame == 'A' )
-		return; // Do nothing
-		
-	else if( received_frame == 'T' )
-		return; // Do nothing
-		
-	else if( received_frame == '\r' ) // <CR>
-		return; // Do nothing
-		
-	else if( received_frame == '\n' ) // <LF>
+	return page;
+}
+
+
+/*-------------------------------------------------------------------------
+* Write packed digits in a page that isn't shown. Positions first + count - 1
+* down to first get the digits, most significant first.
+*------------------------------------------------------------------------*/
+static void write_digits( unsigned char page, unsigned char first, unsigned char count, const unsigned char * digits )
+{
+	unsigned char head = segments_head[page];
+	for( unsigned char k = 0 ; k < count ; k++ )
 	{
-		// Message ended
-		receiver_status = none;
-		 // Increase pending responses counter
-		OK_transmits_left++;
-		// Enable transmitter interrupts to start the response. If it is already enabled, nothing changes.
-		UCSRB |= ( 1 << UDRIE ); // breakpoint here to check memory after message
-	}
-	else // Frame is a number
-	{
-		unsigned char number = received_frame & ascii_to_bcd_mask;
-		// Treatment of a number depends on the type of its message
-		if ( receiver_status == display_message )
-		{	
-			// Moves all data one position forward. Top element gets discarded.
-			for( unsigned char i = num_of_data - 2 ; i != 0xFF ; i-- ) // last element is in position 0x00
-			data[ i + 1 ] = data[i];
-			// Save new data. Top half byte cleared, ascii -> bcd
-			data[0] = number;
+		unsigned char number = digits[k >> 1];
+		number = ( k & 1 ) ? number & 0x0F : number >> 4;
+		unsigned char position = first + count - 1 - k;
+		segments_data[page][( head + position ) & ( num_of_data - 1 )] = pgm_read_byte( &segments_encoding[number] );
+	}
+	// Digits after the lit ones are blank and skipped by the refresh. Extend them over the new digits.
+	unsigned char lit = first + count;
+	if( lit > segments_lit[page] )
+	{
+		segments_lit[page] = lit;
+		segments_dark_ocr[page] = dark_slot_ocr( lit );
+	}
+}
+
+
+/*-------------------------------------------------------------------------
+* Execute a binary frame with a correct CRC. Returns 0 if its type or
+* length is wrong.
+*------------------------------------------------------------------------*/
+static unsigned char binary_execute()
+{
+	unsigned char first, count;
+	const unsigned char * digits;
+	
+	if( binary_type == binary_set_all && binary_length == ( num_of_data + 1 ) / 2 )
+	{
+		first = 0;
+		count = num_of_data;
+		digits = binary_payload;
+	}
+	else if( binary_type == binary_set_range && binary_length >= 2 )
+	{
+		first = binary_payload[0];
+		count = binary_payload[1];
+		digits = &binary_payload[2];
+		if( count == 0 || first >= num_of_data || count > num_of_data - first || binary_length != 2 + ( count + 1 ) / 2 )
+			return 0;
+	}
+	else
+		return 0;
+	
+	write_digits( binary_back_page(), first, count, digits );
+	// Show the new page from the start of the next frame
+	page_written = 0;
+	page_flip_pending = 1;
+	return 1;
+}
+
+
+/*-------------------------------------------------------------------------
+* Receive a byte of a binary frame. Answers ACK for a frame that is
+* executed, NAK for a CRC, type or length error.
+*------------------------------------------------------------------------*/
+static void parse_binary( unsigned char received_frame )
+{
+	if( receiver_status == binary_type_state )
+	{
+		binary_type = received_frame;
+		binary_crc = _crc8_ccitt_update( 0, received_frame );
+		receiver_status = binary_length_state;
+	}
+	else if( receiver_status == binary_length_state )
+	{
+		if( received_frame > binary_max_payload )
+		{
+			// Can't be stored. Frame is dropped, next byte is expected to be a sync or ASCII.
+			receiver_status = none;
+			USART_send( binary_nak );
+			return;
 		}
-		else if( receiver_status == proc_enable_message )
-			// Enable process
-			scheduler_control |= ( 1 << ( number - 1 ) ); // process 1 enable is in bit 0 etc. -1 on number to get the correct bit.
+		binary_length = received_frame;
+		binary_count = 0;
+		binary_crc = _crc8_ccitt_update( binary_crc, received_frame );
+		receiver_status = received_frame != 0 ? binary_payload_state : binary_crc_state;
+	}
+	else if( receiver_status == binary_payload_state )
+	{
+		binary_payload[binary_count++] = received_frame;
+		binary_crc = _crc8_ccitt_update( binary_crc, received_frame );
+		if( binary_count == binary_length )
+			receiver_status = binary_crc_state;
+	}
+	else // CRC
+	{
+		receiver_status = none;
+		if( received_frame == binary_crc && binary_execute() )
+			USART_send( binary_ack );
+		else
+			USART_send( binary_nak );
+	}
+}
+
 
-		else if( receiver_status == proc_disable_message )
-			// Disable process
-			scheduler_control &= ~( 1 << ( number - 1 ) );
+/*-------------------------------------------------------------------------
+* Copy the link counters for the H response. Interrupts update them, the copy
+* is taken at once so the fields agree with each other.
+* A request while the previous response is being sent is ignored.
+*------------------------------------------------------------------------*/
+static void snapshot_link_stats()
+{
+	if( link_stats_next < link_stats_fields )
+		return;
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		link_stats[stat_frame_errors] = frame_errors;
+		link_stats[stat_data_overruns] = data_overruns;
+		link_stats[stat_parity_errors] = parity_errors;
+		link_stats[stat_rx_overruns] = rx_overruns;
+		link_stats[stat_tx_queue_full] = tx_queue_full;
+		link_stats[stat_acks_coalesced] = acks_coalesced;
+		link_stats[stat_rx_bytes] = rx_bytes;
+		link_stats[stat_tx_bytes] = tx_bytes;
+		link_stats[stat_rx_peak] = rx_peak;
 	}
+	link_stats_next = 0;
 }
 
 
+// Class of every ASCII frame, one lookup for any frame. The command set is defined here.
+static const unsigned char frame_classes[128] PROGMEM =
+{
+	['S'] = frame_class_enable,
+	['Q'] = frame_class_disable,
+	['C'] = frame_class_clear,
+	['N'] = frame_class_display,
+	['H'] = frame_class_stats,
+	['A'] = frame_class_ignore,
+	['T'] = frame_class_ignore,
+	['\r'] = frame_class_ignore,
+	['\n'] = frame_class_end,
+};
+
+
 /*-------------------------------------------------------------------------
-* Interrupt service routine for USART transmitter completed.
-* FSM is one way. Only current state is needed to compute next state.
+* Take the action of a number frame. Treatment depends on the type of its message.
 *------------------------------------------------------------------------*/
-ISR( USART_UDRE_vect )
+static inline void parse_number( unsigned char received_frame )
+{
+	unsigned char number = received_frame & ascii_to_bcd_mask;
+	if ( receiver_status == display_message )
+	{	
+		// Moving the head back moves all data one position forward, whatever the number of digits.
+		// Top element is the one before the head and gets overwritten.
+		unsigned char page = front_page ^ 1;
+		unsigned char head = ( segments_head[page] - 1 ) & ( num_of_data - 1 );
+		// Save new data encoded, so the 7 segment driver can output it directly.
+		segments_data[page][head] = ascii_segments( received_frame );
+		segments_head[page] = head;
+		unsigned char lit = segments_lit[page];
+		if( lit < num_of_data )
+		{
+			// Compare value is computed here, so the refresh ISR doesn't multiply
+			lit++;
+			segments_lit[page] = lit;
+			segments_dark_ocr[page] = dark_slot_ocr( lit );
+		}
+	}
+	else if( receiver_status == proc_enable_message || receiver_status == proc_disable_message )
+		// Process number, one or two digits. Too big numbers stay too big.
+		if( process_number <= process_count )
+			process_number = process_number * 10 + number;
+}
+
+
+/*-------------------------------------------------------------------------
+* Take the action of a received frame. Runs in the main loop.
+* ASCII messages have no error detection, binary frames carry a CRC-8.
+* Frames are classified by frame_classes in constant time. Numbers, the most
+* common frames, are tested first, the other classes go through a jump table.
+* Treatment of number frames depends on the start of the message. Memory is needed.
+* For any other frame, only current input is needed to take the appropriate action.
+*------------------------------------------------------------------------*/
+static void parse_frame( unsigned char received_frame )
 {
-	if( transmitter_status == none )
+	// Binary frame in progress
+	if( receiver_status >= binary_type_state )
 	{
-		// Decrease pending responses
-		OK_transmits_left--;
-		// Change State
-		transmitter_status = 'O';
-		// Send character
-		UDR = 'O';
-		// Transmitter's UDR is write-only and can't be read by the simulator.
-		// TCNT2 is used for logging.
-		TCNT2 = 'O';
+		parse_binary( received_frame );
+		return;
 	}
-	else if( transmitter_status == 'O' )
+	
+	unsigned char frame_class = received_frame < sizeof( frame_classes ) ?
+		pgm_read_byte( &frame_classes[received_frame] ) : frame_class_high;
+	if( frame_class == frame_class_number )
 	{
-		// Change State
-		transmitter_status = 'K';
-		// Send character
-		UDR = 'K';
-		TCNT2 = 'K';
+		parse_number( received_frame );
+		return;
 	}
-	else if( transmitter_status == 'K' )
+	
+	switch( frame_class )
 	{
-		// Change State
-		transmitter_status = 0x0D; // CR
-		// Send character
-		UDR = 0x0D;
-		TCNT2 = 0x0D;
+		case frame_class_enable:
+			receiver_status = proc_enable_message; // Set type of message
+			process_number = 0;
+			break;
+		
+		case frame_class_disable:
+			receiver_status = proc_disable_message; // Set type of message
+			process_number = 0;
+			break;
+		
+		case frame_class_clear:
+			clear_back_page();
+			break;
+		
+		case frame_class_display:
+			receiver_status = display_message; // Set type of message
+			clear_back_page();
+			break;
+		
+		case frame_class_stats:
+			snapshot_link_stats(); // Link statistics for the host
+			break;
+		
+		case frame_class_end: // <LF>
+			// Enable or disable the process of an S or Q message. Process n is table entry n-1,
+			// 0 and numbers over process_count are ignored by scheduler_enable.
+			if( receiver_status == proc_enable_message || receiver_status == proc_disable_message )
+				scheduler_enable( process_number - 1, receiver_status == proc_enable_message );
+			// Message ended
+			receiver_status = none;
+			// Show the new page from the start of the next frame
+			if( page_written )
+			{
+				page_written = 0;
+				page_flip_pending = 1;
+			}
+			// Response for the host, sent by send_acks
+			acks_pending++; // breakpoint here to check memory after message
+			break;
+		
+		case frame_class_high:
+			// Start of a binary frame. An unfinished ASCII message is dropped.
+			if( received_frame == binary_sync )
+				receiver_status = binary_type_state;
+			else
+				parse_number( received_frame );
+			break;
+		
+		default: // A, T and <CR>
+			break; // Do nothing
 	}
-	else if( transmitter_status == 0x0D )
+}
+
+
+/*-------------------------------------------------------------------------
+* Free bytes of the transmit queue. Only the UDRE ISR can make it bigger.
+*------------------------------------------------------------------------*/
+static unsigned char tx_space()
+{
+	return ( tx_tail - tx_head - 1 ) & ( tx_buffer_size - 1 );
+}
+
+
+/*-------------------------------------------------------------------------
+* Send the H response, "H" and the counters copied by snapshot_link_stats.
+* The line is longer than the transmit queue, a field is queued when it fits.
+* Returns 1 while fields are left.
+*------------------------------------------------------------------------*/
+static unsigned char send_link_stats()
+{
+	while( link_stats_next < link_stats_fields )
+	{
+		// "H " + 10 digits of an unsigned long + "\r\n"
+		char field[16];
+		char * text = field;
+		if( link_stats_next == 0 )
+			*text++ = 'H';
+		*text++ = ' ';
+		ultoa( link_stats[link_stats_next], text, 10 );
+		if( link_stats_next == link_stats_fields - 1 )
+			strcat( text, "\r\n" );
+		// Waiting for room isn't a full queue, checked before queue counts it
+		if( strlen( field ) > tx_space() )
+			return 1;
+		USART_send_string( field );
+		link_stats_next++;
+	}
+	return 0;
+}
+
+
+/*-------------------------------------------------------------------------
+* Send the responses of the ended messages. An ack waits here while the
+* transmit queue is busy, it isn't lost when the queue is full.
+* With ack_coalescing, acks are sent only when the queue is empty, all pending
+* ones in one "OK n" ("OK" for one). Responses never fall behind the messages
+* and the host adds up the counts to know how many messages were accepted.
+*------------------------------------------------------------------------*/
+static void send_acks()
+{
+	if( acks_pending == 0 )
+		return;
+	#if ack_coalescing
+		// Transmitter is busy, next acks get merged
+		if( tx_head != tx_tail )
+			return;
+		if( acks_pending == 1 )
+			USART_send_string_P( PSTR( "OK\r\n" ) );
+		else
+		{
+			// "OK " + 10 digits of an unsigned long + "\r\n"
+			char response[16] = "OK ";
+			ultoa( acks_pending, &response[3], 10 );
+			strcat( response, "\r\n" );
+			USART_send_string( response );
+			acks_coalesced += acks_pending - 1;
+		}
+		acks_pending = 0;
+	#else
+		while( acks_pending != 0 && tx_space() >= 4 )
+		{
+			USART_send_string_P( PSTR( "OK\r\n" ) );
+			acks_pending--;
+		}
+	#endif
+}
+
+
+/*-------------------------------------------------------------------------
+* Parse the frames stored by the receive ISR. Called from the main loop.
+*------------------------------------------------------------------------*/
+void USART_parse()
+{
+	// Peak backlog of the receiver
+	unsigned char backlog = ( rx_head - rx_tail ) & ( rx_buffer_size - 1 );
+	if( backlog > rx_peak )
+		rx_peak = backlog;
+	
+	while( rx_tail != rx_head )
 	{
-		// Change State
-		transmitter_status = 0x0A; // LF
-		// Send character
-		UDR = 0x0A;
-		TCNT2 = 0x0A;
+		unsigned char tail = rx_tail;
+		parse_frame( rx_buffer[tail] );
+		// Slot is free for the ISR only after the frame is parsed
+		rx_tail = ( tail + 1 ) & ( rx_buffer_size - 1 );
+		#if flow_xon_xoff || flow_rts
+			// Restart the host. Checked again with interrupts disabled, the ISR can stop it in between.
+			if( rx_throttled )
+				ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+					if( ( ( rx_head - rx_tail ) & ( rx_buffer_size - 1 ) ) <= rx_low_watermark )
+						throttle( 0 );
+		#endif
 	}
-	else if( transmitter_status == 0x0A ) // LF
+	// The H response goes out whole before the next acks
+	if( !send_link_stats() )
+		send_acks();
+}
+
+
+/*-------------------------------------------------------------------------
+* Returns 1 while the receive ISR stored frames that aren't parsed yet.
+* Pending responses need no check, the transmitter's interrupts wake the main loop.
+*------------------------------------------------------------------------*/
+unsigned char USART_busy()
+{
+	return rx_tail != rx_head;
+}
+
+
+/*-------------------------------------------------------------------------
+* Copy data to the transmit queue, whole or nothing, and start the transmitter.
+* One atomic block for all the data, producers can be ISRs or the main loop.
+* Returns 0 if the queue can't hold the data.
+*------------------------------------------------------------------------*/
+static unsigned char queue( const char * bytes, unsigned char length, unsigned char program_memory )
+{
+	unsigned char queued = 0;
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
 	{
-		// Change State
-		transmitter_status = none;
-		// If no more transmits required, disable transmitter interrupts.
-		if( OK_transmits_left == 0 )
-			UCSRB &= ~( 1 << UDRIE );
+		unsigned char head = tx_head;
+		// One slot stays empty to tell a full queue from an empty one
+		unsigned char space = ( tx_tail - head - 1 ) & ( tx_buffer_size - 1 );
+		if( length <= space )
+		{
+			for( unsigned char i = 0 ; i < length ; i++ )
+			{
+				tx_buffer[head] = program_memory ? pgm_read_byte( &bytes[i] ) : bytes[i];
+				head = ( head + 1 ) & ( tx_buffer_size - 1 );
+			}
+			tx_head = head;
+			// Start the transmitter. If it is already enabled, nothing changes.
+			if( length != 0 )
+			{
+				#if multidrop
+					// Transmitter was idle, a new response starts with the address of the board
+					if( !( UCSRB & ( 1 << UDRIE ) ) )
+						tx_address_due = 1;
+				#endif
+				UCSRB |= ( 1 << UDRIE );
+			}
+			queued = 1;
+		}
+		else
+			count_saturated( tx_queue_full );
 	}
+	return queued;
+}
+
+
+/*-------------------------------------------------------------------------
+* Queue a byte for the transmitter. Returns 0 if the queue is full.
+*------------------------------------------------------------------------*/
+unsigned char USART_send( unsigned char byte )
+{
+	return queue( (const char *) &byte, 1, 0 );
+}
+
+
+/*-------------------------------------------------------------------------
+* Queue a string from SRAM for the transmitter. Returns 0 if it doesn't fit.
+*------------------------------------------------------------------------*/
+unsigned char USART_send_string( const char * string )
+{
+	return queue( string, strlen( string ), 0 );
+}
+
+
+/*-------------------------------------------------------------------------
+* Queue a string from program memory for the transmitter, see PSTR.
+* Returns 0 if it doesn't fit.
+*------------------------------------------------------------------------*/
+unsigned char USART_send_string_P( const char * string )
+{
+	return queue( string, strlen_P( string ), 1 );
+}
+
+
+/*-------------------------------------------------------------------------
+* Interrupt service routine for USART data register empty.
+* Sends the next byte of the transmit queue. Enabled only while the queue isn't empty
+* or a flow control byte waits.
+*------------------------------------------------------------------------*/
+ISR( USART_UDRE_vect )
+{
+	#if flow_xon_xoff
+		// Flow control goes before the responses
+		unsigned char flow = tx_flow_byte;
+		if( flow )
+		{
+			UDR = flow;
+			TCNT2 = flow;
+			tx_flow_byte = 0;
+			tx_bytes++;
+			if( tx_tail == tx_head )
+				UCSRB &= ~( 1 << UDRIE );
+			return;
+		}
+	#endif
+	#if multidrop
+		// Address frame of the response first, then data frames
+		if( tx_address_due )
+		{
+			tx_address_due = 0;
+			UCSRB |= ( 1 << TXB8 );
+			UDR = node_address;
+			TCNT2 = node_address;
+			tx_bytes++;
+			return;
+		}
+		UCSRB &= ~( 1 << TXB8 );
+	#endif
+	unsigned char tail = tx_tail;
+	unsigned char byte = tx_buffer[tail];
+	// Send character
+	UDR = byte;
+	// Transmitter's UDR is write-only and can't be read by the simulator.
+	// TCNT2 is used for logging.
+	TCNT2 = byte;
+	tail = ( tail + 1 ) & ( tx_buffer_size - 1 );
+	tx_tail = tail;
+	tx_bytes++;
+	// Queue is empty, no interrupts while idle
+	if( tail == tx_head )
+		UCSRB &= ~( 1 << UDRIE );
 }
\ No newline at end of file
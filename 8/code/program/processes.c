@@ -1,7 +1,8 @@
 ﻿/*
  * processes.c
  *
- * Simple processes used to test the scheduler. PORTB is their shared output.
+ * Simple processes used to test the scheduler. process_port (PORTB, PORTA with the
+ * SPI display back end) is their shared output.
  *
  * Created: 27/11/2020
  * Author: Emmanouil Petrakos
@@ -17,50 +18,72 @@ volatile unsigned char bcd_counter_1ms_data __attribute__ ((section (".noinit"))
 volatile unsigned char ring_counter_5ms_data __attribute__ ((section (".noinit")));
 volatile unsigned char LED_blinking_7ms_data __attribute__ ((section (".noinit")));
 
+void bcd_counter_1ms();
+void ring_counter_5ms();
+void LED_blinking_7ms();
+void scheduler_register( unsigned char process, void ( *run )( void ), unsigned char deadline );
+void scheduler_enable( unsigned char process, unsigned char enable );
+
 
 /*-------------------------------------------------------------------------
-* Initialize processes memory and shared port.
+* Initialize processes memory and shared port, and register the processes
+* in the scheduler's table. Called after init_scheduler.
 *------------------------------------------------------------------------*/
 void init_processes()
 {
-	// Set Port B as output
-	DDRB = 0xFF;
+	// Set the shared port as output
+	process_DDR = 0xFF;
 	
 	// Set starting data
 	bcd_counter_1ms_data = 0;
 	ring_counter_5ms_data = 0b10000000;
 	LED_blinking_7ms_data = 0b00000000;
+	
+	#if scheduler_benchmark
+		// Every entry runs one of the bodies, all enabled. A round is process_count ticks.
+		void ( * const bodies[3] )( void ) = { bcd_counter_1ms, ring_counter_5ms, LED_blinking_7ms };
+		for( unsigned char i = 0 ; i < process_count ; i++ )
+		{
+			scheduler_register( i, bodies[i % 3], process_count + 1 );
+			scheduler_enable( i, 1 );
+		}
+	#else
+		// Table entry (process number - 1), body and watchdog deadline in ticks
+		scheduler_register( 0, bcd_counter_1ms, 4 );
+		scheduler_register( 1, ring_counter_5ms, 4 );
+		scheduler_register( 2, LED_blinking_7ms, 4 );
+	#endif
 }
 
 
 /*-------------------------------------------------------------------------
-* Bcd counter with 1ms delay. PORTB is output.
+* Bcd counter with 1ms delay. process_port is output.
 *------------------------------------------------------------------------*/
 void bcd_counter_1ms()
 {
 	_delay_ms(1);
 	bcd_counter_1ms_data++;
-	PORTB = bcd_counter_1ms_data;
+	process_port = bcd_counter_1ms_data;
 }
 
 
 /*-------------------------------------------------------------------------
-* Ring counter with 5ms delay. PORTB is output.
+* Ring counter with 5ms delay. process_port is output.
 *------------------------------------------------------------------------*/
 void ring_counter_5ms()
 {
 	_delay_ms(5);
 	ring_counter_5ms_data = ( ring_counter_5ms_data >> 7 ) | ( ring_counter_5ms_data << 1 );
-	PORTB = ring_counter_5ms_data;
+	process_port = ring_counter_5ms_data;
 }
 
 
 /*-------------------------------------------------------------------------
-* Constant inversion of data with 7ms delay. PORTB is output.
+* Constant inversion of data with 7ms delay. process_port is output.
 *------------------------------------------------------------------------*/
 void LED_blinking_7ms()
 {
 	_delay_ms(7);
 	LED_blinking_7ms_data = LED_blinking_7ms_data ^ 0xFF;
-	PORTB = LED_blinking_7ms_data;
+	process_port = LED_blinking_7ms_data;
 }
\ No newline at end of file
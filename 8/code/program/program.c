@@ -12,25 +12,98 @@
 #include "program.h"
 #include <avr/io.h> // Required for the I/O registers macros
 #include <avr/interrupt.h> // Required for the intrinsic function sei()
+#include <stdlib.h> // Required for utoa
+#include <string.h> // Required for strcat
+#include "../../../common/idle.h"
 
 
 // __attribute__ ((section (".noinit"))) because there is no need to be 
 // initialized to 0 by the compiler.
 // "volatile" to show to compiler that they can change outside the program.
-volatile unsigned char data[8] __attribute__ ((section (".noinit")));
-volatile unsigned char segments_encoding[11] __attribute__ ((section (".noinit")));
+volatile unsigned char segments_data[2][num_of_data] __attribute__ ((section (".noinit")));
+volatile unsigned char segments_head[2] __attribute__ ((section (".noinit")));
+// Digits received since the page was cleared. The rest are blank.
+volatile unsigned char segments_lit[2] __attribute__ ((section (".noinit")));
+volatile unsigned char segments_dark_ocr[2] __attribute__ ((section (".noinit")));
+volatile unsigned char front_page __attribute__ ((section (".noinit")));
+volatile unsigned char page_flip_pending __attribute__ ((section (".noinit")));
+volatile unsigned char digit_index __attribute__ ((section (".noinit")));
+#if display_backend_spi
+	// Shift register chain transfer, see 7_segment_driver.c
+	volatile unsigned char spi_bytes_left __attribute__ ((section (".noinit")));
+	volatile unsigned char spi_anode_byte __attribute__ ((section (".noinit")));
+	volatile unsigned char spi_anode_bits __attribute__ ((section (".noinit")));
+	volatile unsigned char spi_segments __attribute__ ((section (".noinit")));
+#endif
+#if refresh_isr_asm
+	// Timer0 settings of 7_segment_refresh.S. Assembler can't evaluate the timer_setup.h macros.
+	volatile unsigned char digit_slot_TCCR0 __attribute__ ((section (".noinit")));
+	volatile unsigned char digit_slot_OCR0 __attribute__ ((section (".noinit")));
+	volatile unsigned char dark_slot_TCCR0 __attribute__ ((section (".noinit")));
+#endif
+volatile unsigned int refresh_calls __attribute__ ((section (".noinit")));
+volatile unsigned int refresh_calls_per_second __attribute__ ((section (".noinit")));
 
 volatile unsigned char receiver_status __attribute__ ((section (".noinit")));
+// Process number of the current S or Q message, taken at its end
+volatile unsigned char process_number __attribute__ ((section (".noinit")));
+// Set when the back page changed during the current message
+volatile unsigned char page_written __attribute__ ((section (".noinit")));
+// Binary frame being received
+volatile unsigned char binary_type __attribute__ ((section (".noinit")));
+volatile unsigned char binary_length __attribute__ ((section (".noinit")));
+volatile unsigned char binary_count __attribute__ ((section (".noinit")));
+volatile unsigned char binary_crc __attribute__ ((section (".noinit")));
+volatile unsigned char binary_payload[binary_max_payload] __attribute__ ((section (".noinit")));
 
-volatile unsigned char transmitter_status __attribute__ ((section (".noinit")));
-volatile unsigned char OK_transmits_left __attribute__ ((section (".noinit")));
+// Transmit queue. Written by USART_send, read by the UDRE ISR.
+volatile unsigned char tx_buffer[tx_buffer_size] __attribute__ ((section (".noinit")));
+volatile unsigned char tx_head __attribute__ ((section (".noinit")));
+volatile unsigned char tx_tail __attribute__ ((section (".noinit")));
+// Messages ended but not acknowledged yet, see send_acks
+volatile unsigned long acks_pending __attribute__ ((section (".noinit")));
 
-extern unsigned char scheduler_control;
+// Receiver's ring buffer. Written by the receive ISR, read by USART_parse.
+volatile unsigned char rx_buffer[rx_buffer_size] __attribute__ ((section (".noinit")));
+volatile unsigned char rx_head __attribute__ ((section (".noinit")));
+volatile unsigned char rx_tail __attribute__ ((section (".noinit")));
+// Frames lost because the buffer was full
+volatile unsigned int rx_overruns __attribute__ ((section (".noinit")));
+// Link health counters, see the H message
+volatile unsigned int frame_errors __attribute__ ((section (".noinit")));
+volatile unsigned int data_overruns __attribute__ ((section (".noinit")));
+volatile unsigned int parity_errors __attribute__ ((section (".noinit")));
+volatile unsigned int tx_queue_full __attribute__ ((section (".noinit")));
+volatile unsigned long acks_coalesced __attribute__ ((section (".noinit")));
+volatile unsigned long rx_bytes __attribute__ ((section (".noinit")));
+volatile unsigned long tx_bytes __attribute__ ((section (".noinit")));
+volatile unsigned char rx_peak __attribute__ ((section (".noinit")));
+// Copy of the counters sent by the H response, and its next field. link_stats_fields when none.
+volatile unsigned long link_stats[link_stats_fields] __attribute__ ((section (".noinit")));
+volatile unsigned char link_stats_next __attribute__ ((section (".noinit")));
+// Set while flow control stops the host
+volatile unsigned char rx_throttled __attribute__ ((section (".noinit")));
+// XON or XOFF waiting for the transmitter, 0 when none
+volatile unsigned char tx_flow_byte __attribute__ ((section (".noinit")));
+#if multidrop
+	// Set when the next byte of the transmitter is the address frame of a response
+	volatile unsigned char tx_address_due __attribute__ ((section (".noinit")));
+#endif
+
+extern volatile struct process process_table[process_count];
+extern volatile unsigned char scheduler_running;
+#if process_watchdog
+	extern unsigned char watchdog_missed;
+	extern unsigned char watchdog_missed_check;
+#endif
 
 void init_7_seg_driver_IO();
 void init_7_seg_driver_mem();
 void init_USART_driver_IO();
 void init_USART_driver_mem();
+void USART_parse();
+unsigned char USART_busy();
+unsigned char USART_send_string( const char * string );
 
 
 /*-------------------------------------------------------------------------
@@ -40,6 +113,11 @@ void init_USART_driver_mem();
 *------------------------------------------------------------------------*/
 int main()
 {	
+	// avr-libc recommends to store MCUSR in a local variable early after the reset and use that
+	unsigned char reset_source = MCUCSR;
+	// clear MCUCSR
+	MCUCSR = 0x00;
+	
 	// Compiler sets stack pointer. No need for the program to do anything
 	
 	// Initialize drivers
@@ -47,6 +125,23 @@ int main()
 	init_USART_driver_IO();
 	init_7_seg_driver_mem();
 	init_USART_driver_mem();
+	
+	#if process_watchdog
+		// Report the process that missed its deadline before the watchdog reset.
+		// init_scheduler clears it.
+		if( ( reset_source & ( 1 << WDRF ) ) && watchdog_missed != 0 && watchdog_missed <= process_count &&
+			watchdog_missed == (unsigned char) ~watchdog_missed_check )
+		{
+			// "W " + 2 digits + "\r\n"
+			char report[8] = "W ";
+			utoa( watchdog_missed, &report[2], 10 );
+			strcat( report, "\r\n" );
+			USART_send_string( report );
+		}
+	#else
+		(void) reset_source;
+	#endif
+	
 	// Initialize scheduler
 	init_scheduler();
 	// Initialize processes
@@ -57,13 +152,20 @@ int main()
 	
     while(1) 
     {
-		// Continuously call the process chosen by the scheduler
-		if( scheduler_control & ( 1 << SCPR1 ) )
-			bcd_counter_1ms();
-		if( scheduler_control & ( 1 << SCPR2 ) )
-			ring_counter_5ms();
-		if( scheduler_control & ( 1 << SCPR3 ) )
-			LED_blinking_7ms();
+		// Messages are parsed here, interrupts only store the frames
+		USART_parse();
+		// Continuously call the process chosen by the scheduler, one table lookup for any number of processes.
+		// A process checks in when it returns, a hung one misses its deadline
+		unsigned char running = scheduler_running;
+		if( running != no_process )
+		{
+			volatile struct process * process = &process_table[running];
+			process->run();
+			process_check_in( process );
+		}
+		// Sleep until the next interrupt when there are no frames to parse and no process is running.
+		// The scheduler's timer interrupt wakes the loop when it starts a process.
+		idle_unless( USART_busy() || scheduler_running != no_process );
     }
 }
 
@@ -73,14 +175,24 @@ int main()
 *------------------------------------------------------------------------*/
 void init_7_seg_driver_IO()
 {
-	// Set Ports A and C as outputs and initialize
-	DDRA = 0xFF;
-	DDRC = 0xFF;
-	PORTA = 0xFF; // all segments off
-	PORTC = 0b10000000; // in order to start from rightmost 7 segment (AN0)
+	#if display_backend_spi
+		// MOSI, SCK and SS as outputs. SS must not be an input, or a low level stops master mode.
+		DDRB |= ( 1 << PB7 ) | ( 1 << PB5 ) | ( 1 << PB4 );
+		// Latch as output, low. Shift registers output on its rising edge.
+		latch_DDR |= ( 1 << latch_pin );
+		latch_port &= ~( 1 << latch_pin );
+		// Enable SPI as master with its transfer complete interrupt. MSB first, clock fck/16.
+		SPCR = ( 1 << SPIE ) | ( 1 << SPE ) | ( 1 << MSTR ) | ( 1 << SPR0 );
+	#else
+		// Set Ports A and C as outputs and initialize
+		DDRA = 0xFF;
+		DDRC = 0xFF;
+		PORTA = 0xFF; // all segments off
+		PORTC = 0b10000000; // in order to start from rightmost 7 segment (AN0)
+	#endif
 	
-	// Set Timer0 at ~2ms
-	TCCR0 = ( 1 << CS02 ) | ( 1 << WGM01 ); // Set Timer/Counter0 prescaler to 64 and Compare Mode to clear counter on match
+	// Set Timer0 at ~16ms / num_of_data
+	TCCR0 = digit_slot_prescaler | ( 1 << WGM01 ); // Set Timer/Counter0 prescaler and Compare Mode to clear counter on match
 	TIMSK = 1 << OCIE0; // Enable Timer/Counter0 Output Compare Match Interrupt
 	OCR0 = OCR_value;
 }
@@ -91,22 +203,35 @@ void init_7_seg_driver_IO()
 *------------------------------------------------------------------------*/
 void init_7_seg_driver_mem()
 {
-	// Set data
+	// Set data of both pages
 	for( unsigned char i = 0 ; i < num_of_data ; i++ )
-	data[i] = 0x0A;
-	
-	// Set encodings
-	segments_encoding[0] = 0b00000011;
-	segments_encoding[1] = 0b10011111;
-	segments_encoding[2] = 0b00100101;
-	segments_encoding[3] = 0b00001101;
-	segments_encoding[4] = 0b10011001;
-	segments_encoding[5] = 0b01001001;
-	segments_encoding[6] = 0b01000001;
-	segments_encoding[7] = 0b00011111;
-	segments_encoding[8] = 0b00000001;
-	segments_encoding[9] = 0b00001001;
-	segments_encoding[10] = 0b11111111;
+	{
+		segments_data[0][i] = blank_segments;
+		segments_data[1][i] = blank_segments;
+	}
+	// Rightmost digit (AN0) is at the head of the ring buffer
+	segments_head[0] = 0;
+	segments_head[1] = 0;
+	segments_lit[0] = 0;
+	segments_lit[1] = 0;
+	segments_dark_ocr[0] = dark_slot_ocr( 0 );
+	segments_dark_ocr[1] = dark_slot_ocr( 0 );
+	// Page 0 is shown, page 1 is written by the USART driver
+	front_page = 0;
+	page_flip_pending = 0;
+	refresh_calls = 0;
+	refresh_calls_per_second = 0;
+	// Previous digit of AN0, same as the ring counter in PORTC
+	digit_index = num_of_data - 1;
+	#if display_backend_spi
+		spi_bytes_left = 0;
+		spi_anode_bits = 0;
+	#endif
+	#if refresh_isr_asm
+		digit_slot_TCCR0 = digit_slot_prescaler | ( 1 << WGM01 );
+		digit_slot_OCR0 = OCR_value;
+		dark_slot_TCCR0 = dark_slot_prescaler | ( 1 << WGM01 );
+	#endif
 }
 
 
@@ -118,12 +243,16 @@ void init_USART_driver_IO()
 	// Set RXD as input and TXD as output.
 	DDRD |= ( 0 << 0 ); // RXD
 	DDRD |= ( 1 << 1 ); // TXD
+	#if flow_rts
+		// RTS output, low lets the host send
+		rts_port &= ~( 1 << rts_pin );
+		rts_DDR |= ( 1 << rts_pin );
+	#endif
 	
-	// Set UBRR for 9600 baud rate when clock is 10MHz. Let compiler calculate the correct values
-	#include <util/setbaud.h>
-	UBRRH = UBRRH_VALUE;
-	UBRRL = UBRRL_VALUE;
-	#if USE_2X
+	// Set UBRR for the BAUD profile, see baud_setup.h
+	UBRRH = baud_ubrr_value >> 8;
+	UBRRL = baud_ubrr_value & 0xFF;
+	#if baud_use_2x
 		UCSRA |= ( 1 << U2X );
 	#else
 		UCSRA &= ~( 1 << U2X );
@@ -134,6 +263,11 @@ void init_USART_driver_IO()
 	// Enable receiver, receive completed interrupt the transmitter
 	// 8 bit word: UCSZ2 = 0
 	UCSRB = ( 1 << RXEN ) | ( 1 << RXCIE ) | ( 1 << TXEN );
+	#if multidrop
+		// 9 bit frames: UCSZ2 = 1. Only address frames are received until the board is addressed.
+		UCSRB |= ( 1 << UCSZ2 );
+		UCSRA = ( UCSRA & ( 1 << U2X ) ) | ( 1 << MPCM );
+	#endif
 	
 	// Write in UCSRC: URSEL = 1. Asynchronous operation: UMSEL = 0.
 	// Parity Disabled: UPM1:0 = 00. 8 bit word: UCSZ1:0 = 11
@@ -146,8 +280,36 @@ void init_USART_driver_IO()
 *------------------------------------------------------------------------*/
 void init_USART_driver_mem()
 {
-	// Initialize transmitter's FSM to neutral state and number of remaining transmits to 0.
-	transmitter_status = none;
+	// Empty transmit queue
+	tx_head = 0;
+	tx_tail = 0;
+	acks_pending = 0;
+	// No USART instruction started
 	receiver_status = none;
-	OK_transmits_left = 0;
+	process_number = 0;
+	page_written = 0;
+	binary_count = 0;
+	binary_crc = 0;
+	
+	// Empty receiver's ring buffer
+	rx_head = 0;
+	rx_tail = 0;
+	// Host isn't stopped, RTS is low
+	rx_throttled = 0;
+	tx_flow_byte = 0;
+	#if multidrop
+		tx_address_due = 0;
+	#endif
+	rx_overruns = 0;
+	
+	// Clear link health counters
+	frame_errors = 0;
+	data_overruns = 0;
+	parity_errors = 0;
+	tx_queue_full = 0;
+	acks_coalesced = 0;
+	rx_bytes = 0;
+	tx_bytes = 0;
+	rx_peak = 0;
+	link_stats_next = link_stats_fields;
 }
@@ -13,17 +13,151 @@
 #define PROGRAM_H_
 	
 	#define	F_CPU	10000000UL
+	// USART baud rate profile: 9600, 38400, 115200, 250000, 500000 or 1000000.
+	// 115200 and 250000 use U2X at 10 MHz, 500000 and 1000000 need an 8 or 16 MHz clock.
 	#define	BAUD		9600
+	#include "../../../common/baud_setup.h"
+	
+	#include "../../../common/timer_setup.h"
 	
 	#define ascii_to_bcd_mask 0x0F
 	
-	// Compare register value for timer0
-	#define OCR_value 77
+	// Drive the display through a chain of 74HC595 shift registers on the SPI (1),
+	// instead of segments on port A and anodes on port C (0).
+	#define display_backend_spi 0
 	
-	// 1 data for each 7 segment
+	// 1 data for each 7 segment. Up to 8 on ports A/C, up to 32 with the shift registers.
 	#define num_of_data 8
+	// Digit index wraps with a mask, number of digits must be a power of 2
+	#if ( num_of_data & ( num_of_data - 1 ) ) != 0
+		#error "num_of_data must be a power of 2"
+	#endif
+	#if num_of_data > ( display_backend_spi ? 32 : 8 )
+		#error "Too many digits for the display back end"
+	#endif
+	
+	// Receiver's ring buffer, frames wait here for the parser of the main loop.
+	// Processes hold the main loop up to ~13ms, ~13 frames at 9600 baud.
+	// Power of 2, indexes wrap with a mask.
+	#define rx_buffer_size 32
+	#if ( rx_buffer_size & ( rx_buffer_size - 1 ) ) != 0
+		#error "rx_buffer_size must be a power of 2"
+	#endif
+	
+	// Transmit queue. Power of 2, indexes wrap with a mask.
+	#define tx_buffer_size 32
+	#if ( tx_buffer_size & ( tx_buffer_size - 1 ) ) != 0
+		#error "tx_buffer_size must be a power of 2"
+	#endif
+	
+	// Acks that wait for room in the transmit queue are merged in one "OK n"
+	// response. 0 sends an "OK" for every message.
+	#define ack_coalescing 1
+	
+	// Link statistics, sent as "H <fields>\r\n" in this order after an H message.
+	// Error counters stop at 65535, byte totals wrap.
+	#define stat_frame_errors 0 // Frames with a stop bit error (FE), dropped
+	#define stat_data_overruns 1 // Frames lost before UDR was read (DOR)
+	#define stat_parity_errors 2 // Frames with a parity error (PE), dropped
+	#define stat_rx_overruns 3 // Frames lost because the ring buffer was full
+	#define stat_tx_queue_full 4 // Responses lost because the transmit queue was full
+	#define stat_acks_coalesced 5 // Acks merged in an "OK n"
+	#define stat_rx_bytes 6
+	#define stat_tx_bytes 7
+	#define stat_rx_peak 8 // Most frames waiting in the ring buffer
+	#define link_stats_fields 9
+	
+	// Receive flow control. The host is stopped when rx_high_watermark frames wait in
+	// the ring buffer, and restarted when the parser gets them down to rx_low_watermark.
+	// XON/XOFF bytes go out before the queued responses. RTS is an output, high while
+	// the host must stop, for hosts that use CTS.
+	#define flow_xon_xoff 1
+	#define flow_rts 0
+	#define XON 0x11
+	#define XOFF 0x13
+	#define rts_port PORTD
+	#define rts_DDR DDRD
+	#define rts_pin PD2
+	#define rx_high_watermark ( rx_buffer_size * 3 / 4 )
+	#define rx_low_watermark ( rx_buffer_size / 4 )
+	#if rx_low_watermark >= rx_high_watermark || rx_high_watermark >= rx_buffer_size
+		#error "Watermarks must be low < high < rx_buffer_size"
+	#endif
+	
+	// Multi-drop bus: several boards on one line with 9 bit frames (multi-processor
+	// communication mode). A frame with the 9th bit set is an address. The board takes
+	// the data frames after its own address only, MPCM drops the others in hardware,
+	// without an interrupt. Responses start with node_address, sent as an address frame.
+	#define multidrop 0
+	#define node_address 0x01
+	#if multidrop && flow_xon_xoff
+		#error "XON/XOFF can't tell the boards of a multi-drop bus apart, use flow_rts or no flow control"
+	#endif
+	
+	// Shift register chain: one byte for every 8 anodes, followed by the segments byte
+	#define anode_bytes ( ( num_of_data + 7 ) / 8 )
+	// Latch (RCK) of the shift registers
+	#define latch_port PORTD
+	#define latch_DDR DDRD
+	#define latch_pin PD7
+	
+	// A 16ms frame is split in num_of_data slots
+	#define frame_us 16000
+	#define slot_us ( frame_us / num_of_data )
+	// Compare register value for timer0
+	#define OCR_value timer_compare( slot_us, timer_8bit )
+	#if timer_error( slot_us, timer_8bit ) > timer_tolerance
+		#error "Timer0 can't make the digit slot with this F_CPU"
+	#endif
+	// Timer0 prescaler bits for the digit slots and the dark slot.
+	// The dark slot can last a whole frame, so it gets the prescaler of the frame.
+	#define digit_slot_prescaler timer_cs_bits( slot_us, timer_8bit )
+	#define dark_slot_prescaler timer_cs_bits( frame_us, timer_8bit )
+	// Digit slot ticks in one dark slot tick
+	#define dark_slot_ratio ( timer_prescaler( frame_us, timer_8bit ) / timer_prescaler( slot_us, timer_8bit ) )
 	
-	// Used to show no transmitting happened or no USART instruction started
+	// Scan only the lit digits and give the blank ones a single dark slot (0/1).
+	// Frame time and on time of every digit stay the same.
+	#define adaptive_refresh 1
+	// Count refresh interrupts per second (0/1)
+	#define refresh_statistics 1
+	// Use the naked assembly refresh ISR of 7_segment_refresh.S instead of the C one (0/1)
+	#ifndef refresh_isr_asm
+		#define refresh_isr_asm 0
+	#endif
+	#if refresh_isr_asm && display_backend_spi
+		#error "Assembly refresh ISR supports only the port back end"
+	#endif
+	
+	// Compare value of the dark slot, as long as the slots of the blank digits together.
+	// 16 bit math, it is calculated in the USART ISR.
+	#define dark_slot_ocr( lit ) ( ( num_of_data - ( lit ) ) * ( unsigned int )( OCR_value + 1 ) / dark_slot_ratio - 1 )
+	
+	// A dark slot of a whole frame must fit in timer0 with the dark slot prescaler
+	#if num_of_data * ( OCR_value + 1 ) / dark_slot_ratio > timer_8bit + 1
+		#error "Frame too long for the dark slot"
+	#endif
+	
+	// Segments encoding of an empty 7 segment
+	#define blank_segments 0xFF
+	
+	// Glyph codes, indexes of segments_encoding. 0x00 - 0x0F are the hex digits,
+	// the rest are shown by lowercase letters and symbols, see ascii_segments
+	#define glyph_blank 0x10
+	#define glyph_minus 0x11
+	#define glyph_underscore 0x12
+	#define glyph_H 0x13
+	#define glyph_J 0x14
+	#define glyph_L 0x15
+	#define glyph_n 0x16
+	#define glyph_o 0x17
+	#define glyph_P 0x18
+	#define glyph_r 0x19
+	#define glyph_t 0x1A
+	#define glyph_U 0x1B
+	#define glyph_y 0x1C
+	
+	// Used to show no USART instruction started
 	#define none 0x00
 	
 	// Receiver states
@@ -31,17 +165,102 @@
 	#define proc_enable_message 'S'
 	#define proc_disable_message 'Q'
 	
-	// SCheduler Process Enable bits
-	#define	SCPE1	0
-	#define	SCPE2	1
-	#define	SCPE3	2
-	// SCheduler Process Running bits
-	#define	SCPR1	3
-	#define	SCPR2	4
-	#define	SCPR3	5
-	
-	// Compare registers A value for timer1
-	#define OCR1A_value 15624
+	// Classes of the ASCII frames, looked up in frame_classes of USART_driver.c.
+	// Frames missing from the table are numbers.
+	#define frame_class_number 0
+	#define frame_class_ignore 1
+	#define frame_class_enable 2
+	#define frame_class_disable 3
+	#define frame_class_clear 4
+	#define frame_class_display 5
+	#define frame_class_stats 6
+	#define frame_class_end 7
+	#define frame_class_high 8 // Frames above 0x7F, outside the table
+	
+	// Binary frames: sync, type, length, payload, CRC-8 (CCITT) of type, length and payload.
+	// Sync is never part of an ASCII message.
+	#define binary_sync 0x96
+	// Frame types. Digits are packed, 2 per byte, high nibble and most significant digit first.
+	#define binary_set_all 0x01 // payload: all digits
+	#define binary_set_range 0x02 // payload: first digit (0 is AN0), number of digits, digits
+	#define binary_max_payload ( 2 + ( num_of_data + 1 ) / 2 )
+	// Responses of binary frames
+	#define binary_ack 0x06
+	#define binary_nak 0x15
+	// Receiver states of binary frames, above the ASCII message types
+	#define binary_type_state 0x80
+	#define binary_length_state 0x81
+	#define binary_payload_state 0x82
+	#define binary_crc_state 0x83
+	
+	// Shared output port of the scheduler's test processes. The SPI back end drives
+	// PB4 (SS), PB5 (MOSI) and PB7 (SCK), the processes move to port A that it leaves free.
+	#if display_backend_spi
+		#define process_port PORTA
+		#define process_DDR DDRA
+	#else
+		#define process_port PORTB
+		#define process_DDR DDRB
+	#endif
+	
+	// Scheduler's process table. Process n of the S and Q messages is entry n-1,
+	// registered by init_processes with scheduler_register.
+	#ifndef process_count
+		#define process_count 3
+	#endif
+	#if process_count < 1 || process_count > 16
+		#error "process_count must be 1 to 16"
+	#endif
+	// Register and enable all entries at start, for tools/simavr/scheduler_benchmark.sh (0/1)
+	#ifndef scheduler_benchmark
+		#define scheduler_benchmark 0
+	#endif
+	// scheduler_running when no process has the time slice. Right after the entries,
+	// it indexes the first enabled process in the next table, see scheduler.c
+	#define no_process process_count
+	// Process descriptor. C only, 7_segment_refresh.S includes this header too.
+	#ifndef __ASSEMBLER__
+		struct process
+		{
+			void ( *run )( void ); // Called by the main loop while the process has the time slice, 0 if not registered
+			unsigned char enabled; // Set by S, cleared by Q
+			// Software watchdog, see process_watchdog
+			unsigned char deadline; // Ticks allowed between check-ins, up to 127
+			unsigned char due; // Tick of the deadline, see scheduler_ticks
+			unsigned char checked_in; // Set after every run, cleared by the tick
+		};
+	#endif
+	
+	// Scheduler tick of timer1
+	#define scheduler_tick_us 100000
+	// Compare registers A value and prescaler bits for timer1
+	#define OCR1A_value timer_compare( scheduler_tick_us, timer_16bit )
+	#define timer1_prescaler timer_cs_bits( scheduler_tick_us, timer_16bit )
+	#if timer_error( scheduler_tick_us, timer_16bit ) > timer_tolerance
+		#error "Timer1 can't make the scheduler tick with this F_CPU"
+	#endif
+	
+	// Software watchdog of the processes (0/1). An enabled process checks in after
+	// every run and must do so within its deadline, in scheduler ticks, given to
+	// scheduler_register. The hardware watchdog is fed by the tick only while all of
+	// them do, so a hung process resets the board. The process that missed is sent
+	// as "W n" after the reset. A process runs one tick of every round, a deadline
+	// needs at least as many ticks as the enabled processes. The tick checks one
+	// process, a miss is found up to process_count ticks after the deadline.
+	#define process_watchdog 1
+	// Hardware watchdog timeout, over a scheduler tick. The simulator runs the
+	// watchdog from the system clock, Debug builds use 10 times the timeout.
+	#ifdef DEBUG
+		#define process_wdt_timeout WDTO_2S
+	#else
+		#define process_wdt_timeout WDTO_250MS
+	#endif
+	// Check-in of a process, a store of a constant through its descriptor pointer
+	#if process_watchdog
+		#define process_check_in( process ) ( ( process )->checked_in = 1 )
+	#else
+		#define process_check_in( process ) ( (void) 0 )
+	#endif
 	
 
 #endif /* PROGRAM_H_ */
\ No newline at end of file
@@ -1,8 +1,14 @@
 /*
  * scheduler.c
  *
- * Simple ring Scheduler for three processes. Processes can be disabled.
+ * Simple ring Scheduler for a table of up to 16 processes. Processes can be disabled.
  * Time-slice is static at 100 ms. Uses 16 bit Timer1 Compare interrupts.
+ * Enabled processes get the time-slice in ascending order (1, 2, 3, ...), the
+ * bit field scheduler before the table went 3, 2, 1.
+ * The tick has no loop over the table: the next enabled process is looked up in
+ * a table rebuilt when a process is enabled or disabled, and the software
+ * watchdog checks one process per tick. tools/simavr/scheduler_benchmark.sh
+ * measures its cycles for several table sizes.
  *
  * Created: 7/12/2020
  * Author: Emmanouil Petrakos
@@ -13,10 +19,62 @@
 #include "program.h"
 #include <avr/io.h> // Required for the I/O registers macros
 #include <avr/interrupt.h> // Required for the intrinsic function sei()
+#include <avr/wdt.h> // Required for wdt_enable and wdt_reset
+#include <util/atomic.h> // Required for ATOMIC_BLOCK
 
 
-// Save running & enabled processes
-volatile unsigned char scheduler_control __attribute__ ((section (".noinit")));
+// Process descriptors, see struct process
+volatile struct process process_table[process_count] __attribute__ ((section (".noinit")));
+// Process with the time slice, no_process when none
+volatile unsigned char scheduler_running __attribute__ ((section (".noinit")));
+// Next enabled process after every entry, no_process when none. The entry of
+// no_process is the first enabled one. Two rows, the tick reads the front one
+// while scheduler_enable builds the other.
+volatile unsigned char scheduler_next[2][process_count + 1] __attribute__ ((section (".noinit")));
+volatile unsigned char * volatile scheduler_front __attribute__ ((section (".noinit")));
+// Timer1 ticks, wraps. The watchdog deadlines are ticks of it.
+volatile unsigned char scheduler_ticks __attribute__ ((section (".noinit")));
+
+#if process_watchdog
+	// Process that missed its deadline (1 to process_count), 0 for none. Kept through
+	// the watchdog reset for the report, the check byte is its complement.
+	volatile unsigned char watchdog_missed __attribute__ ((section (".noinit")));
+	volatile unsigned char watchdog_missed_check __attribute__ ((section (".noinit")));
+	// Entry checked by the next tick
+	volatile unsigned char watchdog_cursor __attribute__ ((section (".noinit")));
+#endif
+
+#if refresh_statistics
+	extern unsigned int refresh_calls;
+	extern unsigned int refresh_calls_per_second;
+	// Timer1 ticks since the refresh counter was last latched
+	static unsigned char statistics_ticks;
+#endif
+
+
+/*-------------------------------------------------------------------------
+* Build the next enabled process of every entry in the back row, then make it
+* the front one. The pointer is swapped with interrupts disabled, the Timer1 ISR
+* sees the old or the new table. Walks the table backwards twice, the second
+* pass carries the first enabled entry around to the last ones.
+*------------------------------------------------------------------------*/
+static void build_next_table()
+{
+	volatile unsigned char * row = ( scheduler_front == scheduler_next[0] ) ? scheduler_next[1] : scheduler_next[0];
+	unsigned char next = no_process;
+	for( unsigned char pass = 0 ; pass < 2 ; pass++ )
+		for( unsigned char i = process_count ; i-- != 0 ; )
+		{
+			row[i] = next;
+			if( process_table[i].enabled )
+				next = i;
+		}
+	row[no_process] = next;
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		scheduler_front = row;
+	}
+}
 
 
 /*-------------------------------------------------------------------------
@@ -24,61 +82,135 @@ volatile unsigned char scheduler_control __attribute__ ((section (".noinit")));
 *------------------------------------------------------------------------*/
 void init_scheduler()
 {
-	// Enable all processes
-	scheduler_control = 0x00;
-	
+	// Empty table, processes are registered by init_processes
+	for( unsigned char i = 0 ; i < process_count ; i++ )
+	{
+		process_table[i].run = 0;
+		process_table[i].enabled = 0;
+	}
+	scheduler_running = no_process;
+	scheduler_ticks = 0;
+	scheduler_front = scheduler_next[1];
+	build_next_table();
+
 	// Set Timer1 at ~100ms
-	TCCR1B = ( 1 << WGM12 ) | ( 1 << CS11 ) | ( 1 << CS10 ); // Set Timer/Counter2 prescaler to 64 and Compare Mode to clear counter on match
-	TIMSK = 1 << OCIE1A; // Enable Timer/Counter2 Output Compare Match Interrupt
-	
+	TCCR1B = ( 1 << WGM12 ) | timer1_prescaler; // Set Timer/Counter1 prescaler and Compare Mode to clear counter on match
+	TIMSK |= 1 << OCIE1A; // Enable Timer/Counter2 Output Compare Match Interrupt. Keep Timer0 interrupt enabled
+
 	OCR1AH = OCR1A_value >> 8; // High byte
 	OCR1AL = OCR1A_value & 0x00FF; // Lower byte
+
+	#if process_watchdog
+		// Previous miss is already reported
+		watchdog_missed = 0;
+		watchdog_missed_check = 0xFF;
+		watchdog_cursor = 0;
+		wdt_enable( process_wdt_timeout );
+	#endif
 }
 
 
 /*-------------------------------------------------------------------------
-* Interrupt service routine for timer/counter0 compare A match mode.
-* Used to implement scheduler. Gives new time-slice to the next enabled process.
+* Put a process in entry process of the table, disabled. deadline is the
+* ticks of the software watchdog between its check-ins.
 *------------------------------------------------------------------------*/
-ISR( TIMER1_COMPA_vect )
+void scheduler_register( unsigned char process, void ( *run )( void ), unsigned char deadline )
 {
-	// local variable to minimize memory accesses.
-	unsigned char temp = scheduler_control;
-	
-	// No process enabled, stop whatever is running and return.
-	if( !( temp & ( 1 << SCPE3 ) ) && !( temp & ( 1 << SCPE2 ) ) && !( temp & ( 1 << SCPE1 ) ) )
-	{
-		scheduler_control = 0; // Enable bits are already cleared. Clear running bits to stop any running process.
+	if( process >= process_count )
 		return;
+	volatile struct process * descriptor = &process_table[process];
+	descriptor->enabled = 0;
+	descriptor->run = run;
+	descriptor->deadline = deadline;
+	descriptor->due = 0;
+	descriptor->checked_in = 0;
+}
+
+
+/*-------------------------------------------------------------------------
+* Enable (1) or disable (0) entry process of the table, for the S and Q
+* messages. Processes that aren't registered stay disabled. An enabled process
+* gets its whole deadline from now. Rebuilds the next table, O(process_count).
+*------------------------------------------------------------------------*/
+void scheduler_enable( unsigned char process, unsigned char enable )
+{
+	if( process >= process_count || process_table[process].run == 0 )
+		return;
+	volatile struct process * descriptor = &process_table[process];
+	if( enable && !descriptor->enabled )
+	{
+		// Before the flag, the tick never sees it enabled with an old deadline
+		descriptor->checked_in = 0;
+		descriptor->due = scheduler_ticks + descriptor->deadline;
 	}
-	do
+	descriptor->enabled = enable;
+	build_next_table();
+}
+
+
+#if process_watchdog
+/*-------------------------------------------------------------------------
+* Software watchdog of the processes, every tick. A process checks in while it
+* runs, its deadline moves when its time slice ends. One enabled process is
+* checked per tick, the hardware watchdog is fed only while it is within its
+* deadline. After a miss it isn't fed again and the board resets,
+* watchdog_missed keeps the process that missed.
+*------------------------------------------------------------------------*/
+static inline void process_watchdog_tick( unsigned char running, unsigned char now )
+{
+	if( running != no_process )
 	{
-		// SCPR is used like a shift counter.
-		if( temp & ( 1 << SCPR3 ) )
-		{	
-			temp &= ~( 1 << SCPR3 ); // Clear current bit
-			temp |= ( 1 << SCPR2 ); // and set the next
-		}
-		else if( temp & ( 1 << SCPR2 ) )
+		volatile struct process * descriptor = &process_table[running];
+		if( descriptor->checked_in )
 		{
-			temp &= ~( 1 << SCPR2 ); // Clear current bit
-			temp |= ( 1 << SCPR1 ); // and set the next
+			descriptor->checked_in = 0;
+			descriptor->due = now + descriptor->deadline;
 		}
-		else if( temp & ( 1 << SCPR1 ) )
+	}
+
+	unsigned char i = watchdog_cursor;
+	watchdog_cursor = ( i >= process_count - 1 ) ? 0 : i + 1;
+	if( watchdog_missed )
+		return;
+	// Deadlines are up to 127 ticks ahead, past when the difference is positive
+	volatile struct process * checked = &process_table[i];
+	if( checked->enabled && (signed char) ( now - checked->due ) > 0 )
+	{
+		watchdog_missed = i + 1;
+		watchdog_missed_check = ~( i + 1 );
+	}
+	else
+		wdt_reset();
+}
+#endif
+
+
+/*-------------------------------------------------------------------------
+* Interrupt service routine for timer/counter0 compare A match mode.
+* Used to implement scheduler. Gives new time-slice to the next enabled process.
+*------------------------------------------------------------------------*/
+ISR( TIMER1_COMPA_vect )
+{
+	#if refresh_statistics
+		// 10 ticks of 100ms. Latch the refresh interrupts of the last second.
+		if( ++statistics_ticks == 10 )
 		{
-			temp &= ~( 1 << SCPR1 ); // Clear current bit
-			temp |= ( 1 << SCPR3 ); // and set the next
+			statistics_ticks = 0;
+			refresh_calls_per_second = refresh_calls;
+			refresh_calls = 0;
 		}
-		else // No process is running, start with process 3
-			temp |= ( 1 << SCPR3 );
-		
-	} while( // Do this as long as no enabled process is running
-		( !( temp & ( 1 << SCPR3 ) ) || !( temp & ( 1 << SCPE3 ) ) ) && // process 3 is not running or is not enabled AND
-		( !( temp & ( 1 << SCPR2 ) ) || !( temp & ( 1 << SCPE2 ) ) ) && // process 2 is not running or is not enabled AND
-		( !( temp & ( 1 << SCPR1 ) ) || !( temp & ( 1 << SCPE1 ) ) ) ); // process 1 is not running or is not enabled
-	// Loop can run 3 times maximum. At least one process is enabled
-	// and the shift register needs 3 loops to come around.
-	// This happens when the currently running process is the only enabled one.
-	
-	scheduler_control = temp;
-}
\ No newline at end of file
+	#endif
+
+	unsigned char now = ++scheduler_ticks;
+	unsigned char running = scheduler_running;
+	#if process_watchdog
+		process_watchdog_tick( running, now );
+	#else
+		(void) now;
+	#endif
+
+	// Next enabled process after the running one, in table order, no_process when
+	// none is enabled. The only enabled one comes around to itself.
+	// One load from the front row, the same for every table size.
+	scheduler_running = scheduler_front[running];
+}
@@ -9,12 +9,13 @@
 
 #include <avr/io.h> // Required for the I/O registers macros
 #include <avr/interrupt.h> // Required for the intrinsic function sei()
+#include "../../../common/idle.h"
 
 void init_external_interrupt_driver();
 
 /*-------------------------------------------------------------------------
 * Main function. Calls appropriate initialization functions, enables interrupts
-* and stays in a infinite loop.
+* and sleeps in a infinite loop.
 * Functionality is serviced through interrupts.
 *------------------------------------------------------------------------*/
 int main(void)
@@ -25,6 +26,8 @@ int main(void)
 	
     while (1) 
     {
+		// Nothing to do between interrupts, sleep until the next one
+		idle();
     }
 }
 
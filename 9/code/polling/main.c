@@ -10,8 +10,18 @@
 #include <avr/io.h> // Required for the I/O registers macros
 #include <avr/interrupt.h> // Required for the intrinsic function sei()
 
-// Compare register value for 10 ms delay with /1024 prescaler
-#define OCR0_value 97
+#define F_CPU 10000000
+
+#include "../../../common/timer_setup.h"
+
+// Polling period
+#define polling_us 10000
+// Compare register value and prescaler bits for timer0
+#define OCR0_value timer_compare( polling_us, timer_8bit )
+#define timer0_prescaler timer_cs_bits( polling_us, timer_8bit )
+#if timer_error( polling_us, timer_8bit ) > timer_tolerance
+	#error "Timer0 can't make the polling period with this F_CPU"
+#endif
 
 void init_polling_driver();
 
@@ -46,8 +56,8 @@ void init_polling_driver()
 	DDRB |= ( 1 << PB0 );
 	
 	// Set Timer0 at ~10ms
-	// Set Timer/Counter0 prescaler to 1024 and Compare Mode to clear counter on match
-	TCCR0 = ( 1 << CS02 ) | ( 1 << CS00 ) | ( 1 << WGM01 );
+	// Set Timer/Counter0 prescaler and Compare Mode to clear counter on match
+	TCCR0 = timer0_prescaler | ( 1 << WGM01 );
 	// Enable Timer/Counter0 Output Compare Match Interrupt
 	TIMSK = ( 1 << OCIE0 );
 	OCR0 = OCR0_value;
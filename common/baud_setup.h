@@ -0,0 +1,68 @@
+/*
+ * baud_setup.h
+ *
+ * Compile time UBRR value and U2X mode of the USART, derived from F_CPU and BAUD.
+ * Normal mode (16 samples per bit) is used when it is accurate enough,
+ * double speed (U2X, 8 samples per bit) otherwise. The build stops when
+ * neither gets the baud rate within baud_tolerance.
+ * util/setbaud.h only warns in that case.
+ *
+ * Usage:
+ *	#define F_CPU 10000000
+ *	#define BAUD 115200
+ *	#include "../../../common/baud_setup.h"
+ *	...
+ *	UBRRH = baud_ubrr_value >> 8;
+ *	UBRRL = baud_ubrr_value & 0xFF;
+ *	#if baud_use_2x
+ *		UCSRA |= ( 1 << U2X );
+ *	#endif
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ * Developed with AtmelStudio 7.0.129
+ */
+
+
+#ifndef BAUD_SETUP_H_
+#define BAUD_SETUP_H_
+
+	#ifndef F_CPU
+		#error "baud_setup.h requires F_CPU"
+	#endif
+	#ifndef BAUD
+		#error "baud_setup.h requires BAUD"
+	#endif
+
+	// Baud rate profiles known by the host tools
+	#if BAUD != 9600 && BAUD != 38400 && BAUD != 115200 && BAUD != 250000 && BAUD != 500000 && BAUD != 1000000
+		#error "BAUD must be one of 9600, 38400, 115200, 250000, 500000, 1000000"
+	#endif
+
+	// Allowed baud rate error in percent. Can be defined before the include.
+	#ifndef baud_tolerance
+		#define baud_tolerance 2
+	#endif
+
+	// UBRR for 16 (normal) or 8 (U2X) samples per bit, rounded to the nearest
+	#define baud_ubrr( samples ) ( ( ( F_CPU ) + ( samples ) * ( BAUD ) / 2 ) / ( ( samples ) * 1UL * ( BAUD ) ) - 1 )
+
+	// Achieved baud rate
+	#define baud_achieved( samples ) ( ( F_CPU ) / ( ( samples ) * ( baud_ubrr( samples ) + 1 ) ) )
+
+	// Baud rate error in 1/1000, rounded up. 1000 if UBRR can't make the baud rate.
+	#define baud_error( samples ) \
+		( baud_ubrr( samples ) + 1 == 0 || baud_ubrr( samples ) > 4095 ? 1000 : \
+		( ( baud_achieved( samples ) > ( BAUD ) ? \
+		baud_achieved( samples ) - ( BAUD ) : \
+		( BAUD ) - baud_achieved( samples ) ) * 1000 + ( BAUD ) - 1 ) / ( BAUD ) )
+
+	// Double speed only when normal mode isn't accurate enough, it halves the receiver's samples
+	#define baud_use_2x ( baud_error( 16 ) > baud_tolerance * 10 )
+	#define baud_ubrr_value ( baud_use_2x ? baud_ubrr( 8 ) : baud_ubrr( 16 ) )
+
+	#if baud_error( baud_use_2x ? 8 : 16 ) > baud_tolerance * 10
+		#error "Baud rate error over baud_tolerance with this F_CPU, pick another profile or clock"
+	#endif
+
+#endif /* BAUD_SETUP_H_ */
@@ -0,0 +1,56 @@
+/*
+ * idle.h
+ *
+ * Idle path of the main loops. The CPU sleeps in IDLE mode while there is
+ * nothing to do, timers, USART and external interrupts keep running and wake it.
+ *
+ * The check and the sleep are race free. The work condition is tested with
+ * interrupts disabled and sei is followed by sleep. The instruction after sei
+ * always runs before a pending interrupt, so an interrupt that brings work after
+ * the test ends the sleep instead of waiting for the next one.
+ * Every interrupt wakes the CPU, the loop checks again after a wake-up.
+ *
+ * tools/simavr/idle_profile measures the time asleep and the latency the
+ * wake-up adds to the interrupts.
+ *
+ * Usage:
+ *	#include "../../../common/idle.h"
+ *	...
+ *	while(1)
+ *	{
+ *		USART_parse();
+ *		idle_unless( USART_busy() );
+ *	}
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ * Developed with AtmelStudio 7.0.129
+ */
+
+
+#ifndef IDLE_H_
+#define IDLE_H_
+
+	#include <avr/interrupt.h>
+	#include <avr/sleep.h>
+
+	// Sleep until the next interrupt if work is 0. Interrupts are enabled after it.
+	#define idle_unless( work ) \
+		do \
+		{ \
+			cli(); \
+			if( !( work ) ) \
+			{ \
+				set_sleep_mode( SLEEP_MODE_IDLE ); \
+				sleep_enable(); \
+				sei(); \
+				sleep_cpu(); \
+				sleep_disable(); \
+			} \
+			sei(); \
+		} while( 0 )
+
+	// Sleep until the next interrupt, for main loops with all the work in ISRs
+	#define idle() idle_unless( 0 )
+
+#endif /* IDLE_H_ */
@@ -0,0 +1,77 @@
+/*
+ * timer_setup.h
+ *
+ * Compile time prescaler and compare values for Timer0 and Timer1 in CTC mode,
+ * derived from F_CPU and a period in microseconds. Same idea as util/setbaud.h.
+ *
+ * Usage:
+ *	#define F_CPU 10000000
+ *	#include "../../../common/timer_setup.h"
+ *	#define OCR_value timer_compare( 2000, timer_8bit )
+ *	#if timer_error( 2000, timer_8bit ) > timer_tolerance
+ *		#error "Timer0 can't make a 2ms period"
+ *	#endif
+ *	...
+ *	TCCR0 = timer_cs_bits( 2000, timer_8bit ) | ( 1 << WGM01 );
+ *
+ * All values are constant expressions, usable in #if and in C code.
+ * Assembler can't evaluate them (no ?: operator).
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ * Developed with AtmelStudio 7.0.129
+ */
+
+
+#ifndef TIMER_SETUP_H_
+#define TIMER_SETUP_H_
+
+	#ifndef F_CPU
+		#error "timer_setup.h requires F_CPU"
+	#endif
+
+	// Allowed period error in percent. Can be defined before the include.
+	#ifndef timer_tolerance
+		#define timer_tolerance 2
+	#endif
+
+	// Top values of the compare registers
+	#define timer_8bit 255
+	#define timer_16bit 65535
+
+	// CPU cycles in a period. 1UL keeps the math in 32 bits, int is 16 bits on AVR.
+	#define timer_cycles( us ) ( 1UL * ( F_CPU ) / 10000 * ( us ) / 100 )
+
+	// Timer ticks in a period for a prescaler, rounded to the nearest
+	#define timer_ticks( us, prescaler ) ( ( timer_cycles( us ) + ( prescaler ) / 2 ) / ( prescaler ) )
+
+	// Smallest Timer0/Timer1 prescaler that fits the period in the compare register
+	#define timer_prescaler( us, top ) \
+		( timer_ticks( us, 1 ) <= ( top ) + 1UL ? 1 : \
+		timer_ticks( us, 8 ) <= ( top ) + 1UL ? 8 : \
+		timer_ticks( us, 64 ) <= ( top ) + 1UL ? 64 : \
+		timer_ticks( us, 256 ) <= ( top ) + 1UL ? 256 : 1024 )
+
+	// Clock select bits (CSn2:0) of that prescaler
+	#define timer_cs_bits( us, top ) \
+		( timer_prescaler( us, top ) == 1 ? 1 : \
+		timer_prescaler( us, top ) == 8 ? 2 : \
+		timer_prescaler( us, top ) == 64 ? 3 : \
+		timer_prescaler( us, top ) == 256 ? 4 : 5 )
+
+	// Compare register value. Counter clears after it, so one less than the ticks.
+	#define timer_compare( us, top ) ( timer_ticks( us, timer_prescaler( us, top ) ) - 1 )
+
+	// Achieved period in CPU cycles
+	#define timer_achieved_cycles( us, top ) \
+		( timer_ticks( us, timer_prescaler( us, top ) ) * timer_prescaler( us, top ) )
+
+	// Period error in percent, rounded up. 100 if the period doesn't fit at all.
+	#define timer_error( us, top ) \
+		( timer_ticks( us, timer_prescaler( us, top ) ) > ( top ) + 1UL || \
+		timer_ticks( us, timer_prescaler( us, top ) ) == 0 ? 100 : \
+		( ( timer_achieved_cycles( us, top ) > timer_cycles( us ) ? \
+		timer_achieved_cycles( us, top ) - timer_cycles( us ) : \
+		timer_cycles( us ) - timer_achieved_cycles( us, top ) ) * 100 + timer_cycles( us ) - 1 ) / timer_cycles( us ) )
+
+#endif /* TIMER_SETUP_H_ */
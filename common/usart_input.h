@@ -0,0 +1,76 @@
+/*
+ * usart_input.h
+ *
+ * Source of the frames of the USART receive ISR, selected at build time.
+ * On hardware the frame is a single UDR read. The simulator's stimuli files
+ * can't write UDR, they load the frame in r20 and set RXC, so stimuli builds
+ * take the frame from r20. Parsing code is the same in both builds.
+ *
+ * stimuli_input defaults to 1 in Debug builds (DEBUG defined) and 0 otherwise.
+ * It can be defined before the include, e.g. 0 for debugging on a board.
+ * usart_input_9bit also returns the 9th bit (RXB8) of 9 bit frames.
+ *
+ * Usage:
+ *	#include <avr/io.h>
+ *	#include "../../../common/usart_input.h"
+ *	...
+ *	ISR( USART_RXC_vect )
+ *	{
+ *		unsigned char errors;
+ *		unsigned char received_frame = usart_input( &errors ); // First statement, before r20 is used
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ * Developed with AtmelStudio 7.0.129
+ */
+
+
+#ifndef USART_INPUT_H_
+#define USART_INPUT_H_
+
+	#ifndef stimuli_input
+		#ifdef DEBUG
+			#define stimuli_input 1
+		#else
+			#define stimuli_input 0
+		#endif
+	#endif
+
+	static inline unsigned char usart_input_9bit( unsigned char * errors, unsigned char * ninth_bit ) __attribute__ ((always_inline));
+	static inline unsigned char usart_input( unsigned char * errors ) __attribute__ ((always_inline));
+
+	/*-------------------------------------------------------------------------
+	* Read the received frame, its FE, DOR and PE flags in errors and, if
+	* ninth_bit isn't 0, its RXB8 bit in ninth_bit.
+	* Must run before anything in the ISR changes r20.
+	*------------------------------------------------------------------------*/
+	static inline unsigned char usart_input_9bit( unsigned char * errors, unsigned char * ninth_bit )
+	{
+		unsigned char frame;
+		#if stimuli_input
+			// r20 is only read, the compiler still owns it
+			asm volatile( "mov %0 , r20" : "=r" ( frame ) );
+		#endif
+		// Flags and the 9th bit belong to the frame in UDR, they are read first
+		*errors = UCSRA & ( ( 1 << FE ) | ( 1 << DOR ) | ( 1 << PE ) );
+		if( ninth_bit )
+			*ninth_bit = UCSRB & ( 1 << RXB8 );
+		// One read, it also clears RXC. A second read would pop the next frame of the FIFO.
+		#if stimuli_input
+			(void) UDR;
+		#else
+			frame = UDR;
+		#endif
+		return frame;
+	}
+
+
+	/*-------------------------------------------------------------------------
+	* Read the received frame of 8 bit frames and its FE, DOR and PE flags.
+	*------------------------------------------------------------------------*/
+	static inline unsigned char usart_input( unsigned char * errors )
+	{
+		return usart_input_9bit( errors, 0 );
+	}
+
+#endif /* USART_INPUT_H_ */
@@ -0,0 +1,203 @@
+/*
+ * idle_profile.c
+ *
+ * Runs an ATmega16 firmware in simavr for a time while a message is streamed in
+ * the USART at an interval, and profiles the idle path: the part of the time the
+ * core sleeps, the wake-ups, and for every interrupt that ran the latency from
+ * its flag to its vector, apart for flags set while awake and while asleep.
+ * The difference of the means is the latency the wake-up adds.
+ *
+ * Build: gcc -O2 -o idle_profile idle_profile.c sim_common.c -lsimavr -lelf
+ * Usage: idle_profile [-r] <firmware.elf|firmware.hex> [milliseconds] [message] [interval] [baud] [frequency]
+ *        message accepts \r and \n, default "N12345678\r\n", "-" streams nothing.
+ *        interval is the milliseconds between the messages, 0 streams them back to back.
+ *        -r also loads every received frame in r20 at the USART_RXC vector,
+ *        like the stimuli files do, for firmware built with stimuli_input (Debug builds).
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/sim_interrupts.h>
+#include <simavr/avr_uart.h>
+#include "sim_common.h"
+
+#define default_milliseconds 1000
+#define default_message "N12345678\\r\\n"
+#define default_interval 20
+#define default_baud 9600
+
+
+// Latency of the flags set while awake [0] and while asleep [1]
+struct vector_profile
+{
+	int pending;
+	int pending_asleep;
+	avr_cycle_count_t pending_cycle;
+	unsigned long runs[2];
+	avr_cycle_count_t total[2];
+	avr_cycle_count_t max[2];
+};
+
+// Stream and profile state, shared with the callbacks
+static avr_t * avr;
+static avr_irq_t * uart_input;
+static char message[64];
+static unsigned int message_length;
+static unsigned long frames_sent;
+static unsigned long frames_received;
+static avr_cycle_count_t cycles_per_frame;
+static avr_cycle_count_t cycles_per_interval;
+static int core_asleep;
+static struct vector_profile profiles[num_of_vectors];
+
+
+/*-------------------------------------------------------------------------
+* Send the next frame of the stream. The frames of a message are one frame
+* time apart, messages start one interval apart.
+*------------------------------------------------------------------------*/
+static avr_cycle_count_t send_frame( avr_t * avr, avr_cycle_count_t when, void * param )
+{
+	avr_raise_irq( uart_input, (unsigned char) message[frames_sent % message_length] );
+	frames_sent++;
+	if( frames_sent % message_length == 0 && cycles_per_interval > cycles_per_frame * message_length )
+		return when + cycles_per_interval - cycles_per_frame * ( message_length - 1 );
+	return when + cycles_per_frame;
+}
+
+
+/*-------------------------------------------------------------------------
+* A vector became pending: its flag is set. Remember when, and if the core
+* was asleep. The first flag counts until the vector runs.
+*------------------------------------------------------------------------*/
+static void vector_pending( avr_irq_t * irq, uint32_t value, void * param )
+{
+	struct vector_profile * profile = param;
+	if( !value || profile->pending )
+		return;
+	profile->pending = 1;
+	profile->pending_asleep = core_asleep;
+	profile->pending_cycle = avr->cycle;
+}
+
+
+/*-------------------------------------------------------------------------
+* A vector started running. Its latency is the cycles since its flag.
+*------------------------------------------------------------------------*/
+static void vector_running( avr_irq_t * irq, uint32_t value, void * param )
+{
+	struct vector_profile * profile = param;
+	if( !value || !profile->pending )
+		return;
+	avr_cycle_count_t cycles = avr->cycle - profile->pending_cycle;
+	int asleep = profile->pending_asleep;
+	profile->pending = 0;
+	profile->runs[asleep]++;
+	profile->total[asleep] += cycles;
+	if( cycles > profile->max[asleep] )
+		profile->max[asleep] = cycles;
+}
+
+
+/*-------------------------------------------------------------------------
+* Mean latency of a vector's flags set while awake (0) or asleep (1).
+*------------------------------------------------------------------------*/
+static double mean( const struct vector_profile * profile, int asleep )
+{
+	return profile->runs[asleep] ? (double) profile->total[asleep] / profile->runs[asleep] : 0.0;
+}
+
+
+int main( int argc, char * argv[] )
+{
+	int load_r20 = 0;
+	if( argc > 1 && strcmp( argv[1], "-r" ) == 0 )
+	{
+		load_r20 = 1;
+		argc--;
+		argv++;
+	}
+	if( argc < 2 )
+	{
+		fprintf( stderr, "usage: idle_profile [-r] <firmware.elf|firmware.hex> [milliseconds] [message] [interval] [baud] [frequency]\n" );
+		return 1;
+	}
+
+	unsigned long milliseconds = argc > 2 ? strtoul( argv[2], NULL, 0 ) : default_milliseconds;
+	const char * text = argc > 3 ? argv[3] : default_message;
+	message_length = strcmp( text, "-" ) == 0 ? 0 : sim_parse_message( text, message, sizeof( message ) );
+	unsigned long interval = argc > 4 ? strtoul( argv[4], NULL, 0 ) : default_interval;
+	unsigned long baud = argc > 5 ? strtoul( argv[5], NULL, 0 ) : default_baud;
+	unsigned long frequency = argc > 6 ? strtoul( argv[6], NULL, 0 ) : default_frequency;
+	if( milliseconds == 0 || baud == 0 )
+	{
+		fprintf( stderr, "zero milliseconds or zero baud rate\n" );
+		return 1;
+	}
+
+	avr = sim_atmega16( argv[1], frequency );
+	if( !avr )
+		return 1;
+
+	for( int v = 1 ; v < num_of_vectors ; v++ )
+	{
+		avr_irq_t * irq = avr_get_interrupt_irq( avr, v );
+		if( !irq )
+			continue;
+		avr_irq_register_notify( irq + AVR_INT_IRQ_PENDING, vector_pending, &profiles[v] );
+		avr_irq_register_notify( irq + AVR_INT_IRQ_RUNNING, vector_running, &profiles[v] );
+	}
+
+	if( message_length )
+	{
+		uart_input = sim_uart_irq( avr, UART_IRQ_INPUT );
+		cycles_per_frame = sim_frame_cycles( frequency, baud );
+		cycles_per_interval = (avr_cycle_count_t) frequency * interval / 1000;
+		avr_cycle_timer_register( avr, cycles_per_frame, send_frame, NULL );
+	}
+
+	// A sleeping core skips to its next event in one avr_run, the cycles of that run are asleep
+	avr_cycle_count_t end = (avr_cycle_count_t) frequency * milliseconds / 1000;
+	avr_cycle_count_t asleep_cycles = 0;
+	unsigned long wake_ups = 0;
+
+	while( avr->cycle < end )
+	{
+		avr_cycle_count_t start = avr->cycle;
+		core_asleep = avr->state == cpu_Sleeping;
+		if( !sim_step( avr ) )
+			break;
+		if( core_asleep )
+		{
+			asleep_cycles += avr->cycle - start;
+			if( avr->state != cpu_Sleeping )
+				wake_ups++;
+		}
+
+		if( load_r20 && message_length && sim_at_vector( avr, USART_RXC_vector ) )
+			avr->data[20] = (unsigned char) message[frames_received++ % message_length];
+	}
+
+	printf( "%s: %llu cycles, asleep %.1f%%, wake-ups %lu, frames sent %lu\n",
+		argv[1], (unsigned long long) avr->cycle,
+		avr->cycle ? 100.0 * asleep_cycles / avr->cycle : 0.0, wake_ups, frames_sent );
+	for( int v = 1 ; v < num_of_vectors ; v++ )
+	{
+		const struct vector_profile * profile = &profiles[v];
+		if( profile->runs[0] + profile->runs[1] == 0 )
+			continue;
+		printf( "%s: %-12s awake runs %lu mean %.1f max %llu, asleep runs %lu mean %.1f max %llu",
+			argv[1], vector_names[v],
+			profile->runs[0], mean( profile, 0 ), (unsigned long long) profile->max[0],
+			profile->runs[1], mean( profile, 1 ), (unsigned long long) profile->max[1] );
+		if( profile->runs[0] && profile->runs[1] )
+			printf( ", wake-up adds %.1f", mean( profile, 1 ) - mean( profile, 0 ) );
+		printf( "\n" );
+	}
+	return 0;
+}
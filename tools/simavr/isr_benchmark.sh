@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# isr_benchmark.sh
+#
+# Cycles of the 7 segment refresh ISR (TIMER0_COMP) for every driver generation.
+# Projects 2 and 3 are avrasm2 projects, avr-gcc can't build them: their committed
+# .hex is measured. Projects 4 to 8 are built here with avr-gcc and the Debug flags
+# of AtmelStudio, so the images match the sources. Projects 5 to 8 are built twice,
+# with the C refresh ISR and with the assembly one (refresh_isr_asm).
+# Exits with 1 if an image can't be built or measured.
+#
+# Usage: isr_benchmark.sh [count]
+#
+# Created: 17/10/2026
+# Author: Emmanouil Petrakos
+#
+
+cd "$( dirname "$0" )/../.." || exit 1
+count=${1:-1000}
+isr_cycles=tools/simavr/isr_cycles
+output=${TMPDIR:-/tmp}/isr_benchmark
+
+if ! command -v avr-gcc > /dev/null; then
+	echo "avr-gcc not found"
+	exit 1
+fi
+if [ ! -x "$isr_cycles" ]; then
+	echo "$isr_cycles not built"
+	exit 1
+fi
+mkdir -p "$output" || exit 1
+
+failed=0
+
+# Measure the refresh ISR of an image
+measure()
+{
+	if ! "$isr_cycles" "$1" TIMER0_COMP "$count"; then
+		failed=1
+	fi
+}
+
+# Build project $1 as image $2 with the extra flags $3, then measure it
+build_and_measure()
+{
+	sources="$1/code/program"
+	image="$output/$2.elf"
+	if ! avr-gcc -mmcu=atmega16 -std=gnu99 -O1 -funsigned-char -funsigned-bitfields \
+		-ffunction-sections -fdata-sections -fpack-struct -fshort-enums -Wl,--gc-sections \
+		-DDEBUG $3 -o "$image" "$sources"/*.c "$sources"/*.S; then
+		echo "$image: build failed"
+		failed=1
+		return
+	fi
+	measure "$image"
+}
+
+for image in \
+	"2/code/7_segment_driver/Debug/7_segment_driver.hex" \
+	"3/code/program/Debug/program.hex"
+do
+	if [ -f "$image" ]; then
+		measure "$image"
+	else
+		echo "$image: not built"
+		failed=1
+	fi
+done
+
+build_and_measure 4 program_4
+for project in 5 "5 STK500" 6 7 8
+do
+	name=$( echo "$project" | tr ' ' '_' )
+	build_and_measure "$project" "program_${name}_c" -Drefresh_isr_asm=0
+	build_and_measure "$project" "program_${name}_asm" -Drefresh_isr_asm=1
+done
+
+exit $failed
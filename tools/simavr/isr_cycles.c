@@ -0,0 +1,73 @@
+/*
+ * isr_cycles.c
+ *
+ * Runs an ATmega16 firmware in simavr and measures how many cycles an
+ * interrupt service routine takes, from its vector to the instruction after reti.
+ *
+ * Build: gcc -O2 -o isr_cycles isr_cycles.c sim_common.c -lsimavr -lelf
+ * Usage: isr_cycles <firmware.elf|firmware.hex> <vector> [count] [frequency]
+ *        vector is a number (19) or a name (TIMER0_COMP).
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <simavr/sim_avr.h>
+#include "sim_common.h"
+
+#define default_count 1000
+
+
+int main( int argc, char * argv[] )
+{
+	if( argc < 3 )
+	{
+		fprintf( stderr, "usage: %s <firmware.elf|firmware.hex> <vector> [count] [frequency]\n", argv[0] );
+		return 1;
+	}
+
+	int vector = sim_parse_vector( argv[2] );
+	if( vector < 0 )
+	{
+		fprintf( stderr, "unknown vector %s\n", argv[2] );
+		return 1;
+	}
+	unsigned long count = argc > 3 ? strtoul( argv[3], NULL, 0 ) : default_count;
+	unsigned long frequency = argc > 4 ? strtoul( argv[4], NULL, 0 ) : default_frequency;
+
+	avr_t * avr = sim_atmega16( argv[1], frequency );
+	if( !avr )
+		return 1;
+
+	struct sim_isr isr = { .vector = vector };
+	unsigned long runs = 0;
+	avr_cycle_count_t min = ~(avr_cycle_count_t) 0, max = 0, total = 0;
+
+	while( runs < count )
+	{
+		if( !sim_step( avr ) )
+			break;
+
+		avr_cycle_count_t cycles = sim_isr_step( avr, &isr );
+		if( cycles )
+		{
+			runs++;
+			total += cycles;
+			if( cycles < min )
+				min = cycles;
+			if( cycles > max )
+				max = cycles;
+		}
+	}
+
+	if( runs == 0 )
+	{
+		printf( "%s: %s never ran\n", argv[1], vector_names[vector] );
+		return 1;
+	}
+	printf( "%s: %s runs %lu, cycles min %llu max %llu mean %.1f\n", argv[1], vector_names[vector],
+		runs, (unsigned long long) min, (unsigned long long) max, (double) total / runs );
+	return 0;
+}
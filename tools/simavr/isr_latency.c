@@ -0,0 +1,131 @@
+/*
+ * isr_latency.c
+ *
+ * Runs an ATmega16 firmware in simavr while a message is streamed back to back
+ * in the USART, and measures the latency of the refresh interrupt: cycles from
+ * the compare match flag (OCF0) to the TIMER0_COMP vector.
+ *
+ * Build: gcc -O2 -o isr_latency isr_latency.c sim_common.c -lsimavr -lelf
+ * Usage: isr_latency [-r] <firmware.elf|firmware.hex> [count] [message] [baud] [frequency]
+ *        count is the number of TIMER0_COMP runs to measure.
+ *        message accepts \r and \n, default "N12345678\r\n".
+ *        -r also loads every received frame in r20 at the USART_RXC vector,
+ *        like the stimuli files do, for firmware built with stimuli_input (Debug builds).
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_uart.h>
+#include "sim_common.h"
+
+// TIFR in data space and its OCF0 bit
+#define TIFR_address 0x58
+#define OCF0_bit 1
+
+#define default_count 1000
+#define default_message "N12345678\\r\\n"
+#define default_baud 9600
+
+
+// Stream state, shared with the cycle timer callback
+static avr_irq_t * uart_input;
+static char message[64];
+static unsigned int message_length;
+static unsigned long frames_sent;
+static unsigned long frames_received;
+static avr_cycle_count_t cycles_per_frame;
+
+
+/*-------------------------------------------------------------------------
+* Send the next frame of the message, one frame time after the previous one.
+*------------------------------------------------------------------------*/
+static avr_cycle_count_t send_frame( avr_t * avr, avr_cycle_count_t when, void * param )
+{
+	avr_raise_irq( uart_input, (unsigned char) message[frames_sent % message_length] );
+	frames_sent++;
+	return when + cycles_per_frame;
+}
+
+
+int main( int argc, char * argv[] )
+{
+	int load_r20 = 0;
+	if( argc > 1 && strcmp( argv[1], "-r" ) == 0 )
+	{
+		load_r20 = 1;
+		argc--;
+		argv++;
+	}
+	if( argc < 2 )
+	{
+		fprintf( stderr, "usage: isr_latency [-r] <firmware.elf|firmware.hex> [count] [message] [baud] [frequency]\n" );
+		return 1;
+	}
+
+	unsigned long count = argc > 2 ? strtoul( argv[2], NULL, 0 ) : default_count;
+	message_length = sim_parse_message( argc > 3 ? argv[3] : default_message, message, sizeof( message ) );
+	unsigned long baud = argc > 4 ? strtoul( argv[4], NULL, 0 ) : default_baud;
+	unsigned long frequency = argc > 5 ? strtoul( argv[5], NULL, 0 ) : default_frequency;
+	if( message_length == 0 || baud == 0 )
+	{
+		fprintf( stderr, "empty message or zero baud rate\n" );
+		return 1;
+	}
+
+	avr_t * avr = sim_atmega16( argv[1], frequency );
+	if( !avr )
+		return 1;
+
+	uart_input = sim_uart_irq( avr, UART_IRQ_INPUT );
+	cycles_per_frame = sim_frame_cycles( frequency, baud );
+	avr_cycle_timer_register( avr, cycles_per_frame, send_frame, NULL );
+
+	unsigned long runs = 0;
+	avr_cycle_count_t flag_cycle = 0, min = ~(avr_cycle_count_t) 0, max = 0, total = 0;
+	int flag_pending = 0;
+
+	while( runs < count )
+	{
+		if( !sim_step( avr ) )
+			break;
+
+		if( load_r20 && sim_at_vector( avr, USART_RXC_vector ) )
+			avr->data[20] = (unsigned char) message[frames_received++ % message_length];
+
+		if( !flag_pending )
+		{
+			// Flag is seen after the instruction that was running when it was set
+			if( avr->data[TIFR_address] & ( 1 << OCF0_bit ) )
+			{
+				flag_pending = 1;
+				flag_cycle = avr->cycle;
+			}
+		}
+		else if( sim_at_vector( avr, TIMER0_COMP_vector ) )
+		{
+			avr_cycle_count_t cycles = avr->cycle - flag_cycle;
+			flag_pending = 0;
+			runs++;
+			total += cycles;
+			if( cycles < min )
+				min = cycles;
+			if( cycles > max )
+				max = cycles;
+		}
+	}
+
+	if( runs == 0 )
+	{
+		printf( "%s: TIMER0_COMP never ran\n", argv[1] );
+		return 1;
+	}
+	printf( "%s: TIMER0_COMP runs %lu, frames sent %lu, latency cycles min %llu max %llu mean %.1f\n",
+		argv[1], runs, frames_sent, (unsigned long long) min, (unsigned long long) max, (double) total / runs );
+	return 0;
+}
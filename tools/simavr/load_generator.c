@@ -0,0 +1,476 @@
+/*
+ * load_generator.c
+ *
+ * Runs an ATmega16 firmware in simavr with its USART attached to a pseudo
+ * terminal, and streams a workload through the pty like a host on a serial
+ * port. Measures messages per second, ack latency percentiles, lost acks and
+ * garbled response lines.
+ *
+ * Frames enter the USART at the line rate of the baud argument, in simulated
+ * time. The workload is built before the run and the simulator waits for the
+ * pty while its next frame isn't there yet, so the frames and their cycles
+ * depend only on the seed: runs with the same seed load every firmware revision
+ * the same way.
+ * Latency is counted in simulated cycles from the LF of a message to the LF of
+ * the response that acks it ("OK", or "OK n" for n merged acks).
+ * The stream pauses between an XOFF and an XON of the firmware.
+ *
+ * Workloads:
+ *   display    random N messages with 1 to 8 digits
+ *   scheduler  random S and Q messages for processes 1 to 3 (projects 7, 8)
+ *   mixed      display with a scheduler message every 4th message
+ *
+ * Build: gcc -O2 -o load_generator load_generator.c sim_common.c -lsimavr -lelf -lpthread
+ * Usage: load_generator [-r] [-p] [-w workload] [-m messages] [-g gap_us] [-s seed]
+ *                       [-b baud] [-f frequency] [-l log] <firmware.elf|firmware.hex>
+ *        -g is the idle time after every message, 0 (default) streams back to back.
+ *        -p only prints the pty and runs the firmware, for another host program.
+ *        -l writes everything the host reads from the pty in a file.
+ *        -r also loads every received frame in r20 at the USART_RXC vector,
+ *        like the stimuli files do, for firmware built with stimuli_input (Debug builds).
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ */
+
+#define _GNU_SOURCE // Required for posix_openpt and cfmakeraw
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <poll.h>
+#include <pthread.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_uart.h>
+#include "sim_common.h"
+
+// Software flow control bytes of the firmware
+#define XON 0x11
+#define XOFF 0x13
+
+#define default_messages 1000
+#define default_baud 9600
+#define default_seed 1
+
+// Longest message of the workloads, "N12345678\r\n"
+#define max_message 11
+
+// Acks still missing this many message times after the last frame are lost
+#define drain_messages 8
+
+
+// Bridge state, used by the cycle timer and the USART callbacks of the simulator
+static avr_irq_t * uart_input;
+static int pty_master;
+static unsigned char pending[256];
+static unsigned int pending_length;
+static unsigned int pending_index;
+static int load_r20;
+static unsigned char last_frame;
+static int stopped;
+static unsigned long xoffs;
+static avr_cycle_count_t cycles_per_frame;
+static avr_cycle_count_t gap_cycles;
+static avr_cycle_count_t first_frame_cycle;
+static avr_cycle_count_t last_frame_cycle;
+static avr_cycle_count_t last_ack_cycle;
+static unsigned long frames_sent;
+// Frames of the workload still to come through the pty, 0 with -p
+static size_t frames_due;
+
+// Messages: cycle of their LF, and ack latency
+static unsigned long messages;
+static unsigned long messages_sent;
+static unsigned long acked;
+static avr_cycle_count_t * sent_cycle;
+static avr_cycle_count_t * latency;
+
+// Response line being received
+static char line[64];
+static unsigned int line_length;
+static unsigned long garbled;
+static unsigned long over_acks;
+
+// Workload, written in the pty by the host thread
+static char * workload;
+static size_t workload_length;
+static const char * log_path;
+
+
+/*-------------------------------------------------------------------------
+* Build a workload of count messages. Returns its length, 0 for an unknown one.
+*------------------------------------------------------------------------*/
+static size_t build_workload( const char * name, unsigned long count, unsigned int seed, char * out )
+{
+	int display = strcmp( name, "display" ) == 0;
+	int scheduler = strcmp( name, "scheduler" ) == 0;
+	int mixed = strcmp( name, "mixed" ) == 0;
+	if( !display && !scheduler && !mixed )
+		return 0;
+
+	size_t length = 0;
+	srand( seed );
+	for( unsigned long i = 0 ; i < count ; i++ )
+	{
+		if( scheduler || ( mixed && i % 4 == 3 ) )
+		{
+			out[length++] = rand() % 2 ? 'S' : 'Q';
+			out[length++] = '1' + rand() % 3;
+		}
+		else
+		{
+			out[length++] = 'N';
+			int digits = 1 + rand() % 8;
+			for( int j = 0 ; j < digits ; j++ )
+				out[length++] = '0' + rand() % 10;
+		}
+		out[length++] = '\r';
+		out[length++] = '\n';
+	}
+	return length;
+}
+
+
+/*-------------------------------------------------------------------------
+* Host side: write the workload in the pty slave, and read the responses
+* so the pty doesn't fill. Runs in its own thread, writes block at the line rate.
+*------------------------------------------------------------------------*/
+static void * host( void * param )
+{
+	int slave = *(int *) param;
+	FILE * log = log_path ? fopen( log_path, "wb" ) : NULL;
+	size_t written = 0;
+
+	while( 1 )
+	{
+		fd_set read_set, write_set;
+		FD_ZERO( &read_set );
+		FD_ZERO( &write_set );
+		FD_SET( slave, &read_set );
+		if( written < workload_length )
+			FD_SET( slave, &write_set );
+		if( select( slave + 1, &read_set, &write_set, NULL, NULL ) < 0 )
+			break;
+
+		if( FD_ISSET( slave, &read_set ) )
+		{
+			char buffer[256];
+			ssize_t length = read( slave, buffer, sizeof( buffer ) );
+			if( length > 0 && log )
+			{
+				fwrite( buffer, 1, length, log );
+				fflush( log );
+			}
+		}
+		if( FD_ISSET( slave, &write_set ) )
+		{
+			ssize_t length = write( slave, workload + written, workload_length - written );
+			if( length > 0 )
+				written += length;
+		}
+	}
+	return NULL;
+}
+
+
+/*-------------------------------------------------------------------------
+* Send the next frame from the pty, one frame time after the previous one,
+* and the gap after every message. While frames of the workload are due, it
+* waits for the host thread, so no frame slot is lost to the thread timing.
+* With -p it polls the pty while it is empty.
+*------------------------------------------------------------------------*/
+static avr_cycle_count_t send_frame( avr_t * avr, avr_cycle_count_t when, void * param )
+{
+	// Stopped by XOFF, check again after a frame time
+	if( stopped )
+		return when + cycles_per_frame;
+
+	if( pending_index == pending_length )
+	{
+		if( frames_due )
+		{
+			struct pollfd readable = { pty_master, POLLIN, 0 };
+			while( poll( &readable, 1, -1 ) < 0 && errno == EINTR )
+				;
+		}
+		ssize_t length = read( pty_master, pending, sizeof( pending ) );
+		if( length <= 0 )
+			return when + cycles_per_frame;
+		pending_length = length;
+		pending_index = 0;
+		frames_due = (size_t) length < frames_due ? frames_due - length : 0;
+	}
+
+	unsigned char frame = pending[pending_index++];
+	if( frames_sent == 0 )
+		first_frame_cycle = avr->cycle;
+	last_frame_cycle = avr->cycle;
+	frames_sent++;
+	last_frame = frame;
+	avr_raise_irq( uart_input, frame );
+
+	if( frame == '\n' )
+	{
+		if( messages_sent < messages )
+			sent_cycle[messages_sent] = avr->cycle;
+		messages_sent++;
+		return when + cycles_per_frame + gap_cycles;
+	}
+	return when + cycles_per_frame;
+}
+
+
+/*-------------------------------------------------------------------------
+* Check a response line and take the latency of the messages it acks.
+*------------------------------------------------------------------------*/
+static void parse_line( avr_t * avr )
+{
+	unsigned long count = 0;
+	line[line_length] = 0;
+
+	if( strcmp( line, "OK\r" ) == 0 )
+		count = 1;
+	else if( strncmp( line, "OK ", 3 ) == 0 )
+	{
+		char * end;
+		count = strtoul( &line[3], &end, 10 );
+		if( count < 2 || strcmp( end, "\r" ) != 0 )
+		{
+			garbled++;
+			return;
+		}
+	}
+	else
+	{
+		// Link statistics, reset log, watchdog report and the reset response aren't acks
+		if( !( ( line[0] == 'H' || line[0] == 'E' || line[0] == 'W' ) && line[1] == ' ' ) &&
+			strcmp( line, "R\r" ) != 0 )
+			garbled++;
+		return;
+	}
+
+	last_ack_cycle = avr->cycle;
+	for( unsigned long i = 0 ; i < count ; i++ )
+	{
+		// More acks than messages, the count is wrong
+		if( acked == messages_sent || acked == messages )
+		{
+			over_acks += count - i;
+			return;
+		}
+		latency[acked] = avr->cycle - sent_cycle[acked];
+		acked++;
+	}
+}
+
+
+/*-------------------------------------------------------------------------
+* Take a byte of the firmware: pass it to the host, follow flow control
+* and parse the response lines.
+*------------------------------------------------------------------------*/
+static void receive_response( avr_irq_t * irq, uint32_t value, void * param )
+{
+	avr_t * avr = param;
+	unsigned char byte = value;
+
+	// Host reads the pty. If it doesn't keep up, the byte is dropped like an overrun.
+	if( write( pty_master, &byte, 1 ) < 0 && errno != EAGAIN )
+		perror( "pty" );
+
+	if( byte == XOFF )
+	{
+		stopped = 1;
+		xoffs++;
+	}
+	else if( byte == XON )
+		stopped = 0;
+	else if( byte == '\n' )
+	{
+		parse_line( avr );
+		line_length = 0;
+	}
+	else if( line_length < sizeof( line ) - 1 )
+		line[line_length++] = byte;
+	else
+	{
+		// No response is this long
+		garbled++;
+		line_length = 0;
+	}
+}
+
+
+/*-------------------------------------------------------------------------
+* Open a pty in raw mode. Returns the master and the slave file descriptors.
+*------------------------------------------------------------------------*/
+static int open_pty( int * master, int * slave, char * name, size_t size )
+{
+	*master = posix_openpt( O_RDWR | O_NOCTTY );
+	if( *master < 0 || grantpt( *master ) != 0 || unlockpt( *master ) != 0 )
+		return -1;
+	strncpy( name, ptsname( *master ), size - 1 );
+	name[size - 1] = 0;
+	*slave = open( name, O_RDWR | O_NOCTTY );
+	if( *slave < 0 )
+		return -1;
+
+	// No line editing or CR/LF translation on either side
+	struct termios settings;
+	tcgetattr( *slave, &settings );
+	cfmakeraw( &settings );
+	tcsetattr( *slave, TCSANOW, &settings );
+	tcgetattr( *master, &settings );
+	cfmakeraw( &settings );
+	tcsetattr( *master, TCSANOW, &settings );
+
+	fcntl( *master, F_SETFL, fcntl( *master, F_GETFL ) | O_NONBLOCK );
+	return 0;
+}
+
+
+static int compare_cycles( const void * a, const void * b )
+{
+	avr_cycle_count_t x = *(const avr_cycle_count_t *) a, y = *(const avr_cycle_count_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+
+int main( int argc, char * argv[] )
+{
+	const char * workload_name = "display";
+	unsigned long baud = default_baud;
+	unsigned long frequency = default_frequency;
+	unsigned long gap_us = 0;
+	unsigned int seed = default_seed;
+	int pty_only = 0;
+	int option;
+
+	messages = default_messages;
+	while( ( option = getopt( argc, argv, "rpw:m:g:s:b:f:l:" ) ) != -1 )
+	{
+		switch( option )
+		{
+			case 'r': load_r20 = 1; break;
+			case 'p': pty_only = 1; break;
+			case 'w': workload_name = optarg; break;
+			case 'm': messages = strtoul( optarg, NULL, 0 ); break;
+			case 'g': gap_us = strtoul( optarg, NULL, 0 ); break;
+			case 's': seed = strtoul( optarg, NULL, 0 ); break;
+			case 'b': baud = strtoul( optarg, NULL, 0 ); break;
+			case 'f': frequency = strtoul( optarg, NULL, 0 ); break;
+			case 'l': log_path = optarg; break;
+			default: optind = argc; break;
+		}
+	}
+	if( optind != argc - 1 )
+	{
+		fprintf( stderr, "usage: load_generator [-r] [-p] [-w display|scheduler|mixed] [-m messages] [-g gap_us]\n"
+			"                      [-s seed] [-b baud] [-f frequency] [-l log] <firmware.elf|firmware.hex>\n" );
+		return 1;
+	}
+	const char * firmware = argv[optind];
+	if( baud == 0 || messages == 0 )
+	{
+		fprintf( stderr, "zero messages or zero baud rate\n" );
+		return 1;
+	}
+
+	workload = malloc( messages * max_message );
+	sent_cycle = calloc( messages, sizeof( avr_cycle_count_t ) );
+	latency = calloc( messages, sizeof( avr_cycle_count_t ) );
+	if( !workload || !sent_cycle || !latency )
+	{
+		fprintf( stderr, "out of memory\n" );
+		return 1;
+	}
+	if( !pty_only )
+	{
+		workload_length = build_workload( workload_name, messages, seed, workload );
+		if( workload_length == 0 )
+		{
+			fprintf( stderr, "unknown workload %s\n", workload_name );
+			return 1;
+		}
+		frames_due = workload_length;
+	}
+
+	avr_t * avr = sim_atmega16( firmware, frequency );
+	if( !avr )
+		return 1;
+
+	int pty_slave;
+	char pty_name[64];
+	if( open_pty( &pty_master, &pty_slave, pty_name, sizeof( pty_name ) ) != 0 )
+	{
+		perror( "pty" );
+		return 1;
+	}
+	printf( "%s: USART on %s\n", firmware, pty_name );
+	fflush( stdout );
+
+	uart_input = sim_uart_irq( avr, UART_IRQ_INPUT );
+	avr_irq_register_notify( sim_uart_irq( avr, UART_IRQ_OUTPUT ), receive_response, avr );
+	cycles_per_frame = sim_frame_cycles( frequency, baud );
+	gap_cycles = (avr_cycle_count_t) frequency / 1000000 * gap_us;
+	avr_cycle_timer_register( avr, cycles_per_frame, send_frame, NULL );
+
+	// Another host program drives the pty, run until the firmware stops
+	if( pty_only )
+	{
+		close( pty_slave );
+		while( 1 )
+		{
+			if( !sim_step( avr ) )
+				break;
+			if( load_r20 && sim_at_vector( avr, USART_RXC_vector ) )
+				avr->data[20] = last_frame;
+		}
+		return 0;
+	}
+
+	pthread_t host_thread;
+	if( pthread_create( &host_thread, NULL, host, &pty_slave ) != 0 )
+	{
+		fprintf( stderr, "can't start the host thread\n" );
+		return 1;
+	}
+
+	// Run until all messages are acked, or acks stop arriving after the stream ended
+	avr_cycle_count_t message_cycles = cycles_per_frame * max_message + gap_cycles;
+	while( acked < messages )
+	{
+		if( !sim_step( avr ) )
+			break;
+		if( messages_sent >= messages &&
+			avr->cycle > last_frame_cycle + drain_messages * message_cycles )
+			break;
+		// Only the frame just sent can be in the ISR, the simulator has no receive FIFO delay
+		if( load_r20 && sim_at_vector( avr, USART_RXC_vector ) )
+			avr->data[20] = last_frame;
+	}
+
+	if( acked == 0 )
+	{
+		printf( "%s: %lu baud, no acks\n", firmware, baud );
+		return 1;
+	}
+	double seconds = (double) ( last_ack_cycle - first_frame_cycle ) / frequency;
+	printf( "%s: %s, %lu baud, gap %lu us, seed %u\n", firmware, workload_name, baud, gap_us, seed );
+	printf( "%s: messages %lu, acked %lu, lost %lu, over-acked %lu, garbled lines %lu, XOFF %lu\n",
+		firmware, messages, acked, messages - acked, over_acks, garbled, xoffs );
+	printf( "%s: %.1f messages/s (line limit %.1f)\n", firmware, acked / seconds,
+		(double) baud / bits_per_frame / ( (double) workload_length / messages ) );
+
+	// Percentiles of the ack latency, in microseconds
+	qsort( latency, acked, sizeof( avr_cycle_count_t ), compare_cycles );
+	double us_per_cycle = 1000000.0 / frequency;
+	printf( "%s: ack latency us p50 %.1f p90 %.1f p99 %.1f max %.1f\n", firmware,
+		latency[acked / 2] * us_per_cycle, latency[acked * 9 / 10] * us_per_cycle,
+		latency[acked * 99 / 100] * us_per_cycle, latency[acked - 1] * us_per_cycle );
+	return 0;
+}
@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# scheduler_benchmark.sh
+#
+# Cycles of the scheduler tick ISR (TIMER1_COMPA) of project 8 for table sizes
+# from 3 to 16 processes. Every size is built with avr-gcc and the Debug flags
+# of AtmelStudio, with scheduler_benchmark set: all the entries are registered
+# and enabled. Prints the isr_cycles line of every size, then whether the min
+# and max cycles are the same for all of them. Exits with 1 if a size can't be
+# built or measured, or the cycles differ.
+#
+# Usage: scheduler_benchmark.sh [count] [sizes]
+#        count is the ticks measured (100 ms apart), default 50.
+#        sizes is a list of process_count values, default "3 8 16".
+#
+# Created: 17/10/2026
+# Author: Emmanouil Petrakos
+#
+
+cd "$( dirname "$0" )/../.." || exit 1
+count=${1:-50}
+sizes=${2:-3 8 16}
+isr_cycles=tools/simavr/isr_cycles
+sources=8/code/program
+output=${TMPDIR:-/tmp}/scheduler_benchmark
+
+if ! command -v avr-gcc > /dev/null; then
+	echo "avr-gcc not found"
+	exit 1
+fi
+if [ ! -x "$isr_cycles" ]; then
+	echo "$isr_cycles not built"
+	exit 1
+fi
+mkdir -p "$output" || exit 1
+
+failed=0
+first=""
+flat=1
+for size in $sizes
+do
+	image="$output/program_$size.elf"
+	if ! avr-gcc -mmcu=atmega16 -std=gnu99 -O1 -funsigned-char -funsigned-bitfields \
+		-ffunction-sections -fdata-sections -fpack-struct -fshort-enums -Wl,--gc-sections \
+		-DDEBUG -Dprocess_count="$size" -Dscheduler_benchmark=1 \
+		-o "$image" "$sources"/*.c "$sources"/*.S; then
+		echo "$image: build failed"
+		failed=1
+		continue
+	fi
+	result=$( "$isr_cycles" "$image" TIMER1_COMPA "$count" )
+	echo "$result"
+	# "cycles min <n> max <n>" of the isr_cycles line
+	cycles=$( echo "$result" | sed -n 's/.*cycles \(min [0-9]* max [0-9]*\).*/\1/p' )
+	if [ -z "$cycles" ]; then
+		failed=1
+	elif [ -z "$first" ]; then
+		first=$cycles
+	elif [ "$cycles" != "$first" ]; then
+		flat=0
+	fi
+done
+
+if [ $failed -ne 0 ]; then
+	echo "not measured for every size"
+	exit 1
+fi
+if [ $flat -eq 0 ]; then
+	echo "tick cycles differ between sizes"
+	exit 1
+fi
+echo "tick cycles $first for sizes $sizes"
@@ -0,0 +1,191 @@
+/*
+ * sim_common.c
+ *
+ * Helpers shared by the simavr tools, see sim_common.h.
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_hex.h>
+#include <simavr/avr_uart.h>
+#include "sim_common.h"
+
+
+const char * const vector_names[num_of_vectors] =
+{
+	"RESET", "INT0", "INT1", "TIMER2_COMP", "TIMER2_OVF", "TIMER1_CAPT",
+	"TIMER1_COMPA", "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_OVF", "SPI_STC",
+	"USART_RXC", "USART_UDRE", "USART_TXC", "ADC", "EE_RDY", "ANA_COMP",
+	"TWI", "INT2", "TIMER0_COMP", "SPM_RDY"
+};
+
+
+/*-------------------------------------------------------------------------
+* Convert a vector number or name to its number. -1 if unknown.
+*------------------------------------------------------------------------*/
+int sim_parse_vector( const char * text )
+{
+	char * end;
+	long number = strtol( text, &end, 0 );
+	if( *end == '\0' )
+		return ( number > 0 && number < num_of_vectors ) ? (int) number : -1;
+
+	for( int i = 0 ; i < num_of_vectors ; i++ )
+		if( strcmp( text, vector_names[i] ) == 0 )
+			return i;
+	return -1;
+}
+
+
+/*-------------------------------------------------------------------------
+* Copy a message, replacing the \r and \n escapes. Returns its length.
+*------------------------------------------------------------------------*/
+unsigned int sim_parse_message( const char * text, char * out, unsigned int size )
+{
+	unsigned int length = 0;
+	while( *text && length < size )
+	{
+		if( text[0] == '\\' && text[1] == 'r' )
+		{
+			out[length++] = '\r';
+			text += 2;
+		}
+		else if( text[0] == '\\' && text[1] == 'n' )
+		{
+			out[length++] = '\n';
+			text += 2;
+		}
+		else
+			out[length++] = *text++;
+	}
+	return length;
+}
+
+
+/*-------------------------------------------------------------------------
+* Load an .elf or an Intel .hex image in the simulated flash.
+*------------------------------------------------------------------------*/
+static int load_firmware( avr_t * avr, const char * path )
+{
+	const char * extension = strrchr( path, '.' );
+
+	if( extension && strcmp( extension, ".hex" ) == 0 )
+	{
+		ihex_chunk_p chunks;
+		int num_of_chunks = read_ihex_chunks( path, &chunks );
+		if( num_of_chunks <= 0 )
+			return -1;
+		for( int i = 0 ; i < num_of_chunks ; i++ )
+			avr_loadcode( avr, chunks[i].data, chunks[i].size, chunks[i].baseaddr );
+		free_ihex_chunks( chunks );
+		return 0;
+	}
+
+	elf_firmware_t firmware;
+	memset( &firmware, 0, sizeof( firmware ) );
+	if( elf_read_firmware( path, &firmware ) != 0 )
+		return -1;
+	avr_load_firmware( avr, &firmware );
+	return 0;
+}
+
+
+/*-------------------------------------------------------------------------
+* New ATmega16 core at frequency with the firmware of path in its flash.
+* Prints the error and returns NULL when it fails.
+*------------------------------------------------------------------------*/
+avr_t * sim_atmega16( const char * path, unsigned long frequency )
+{
+	avr_t * avr = avr_make_mcu_by_name( "atmega16" );
+	if( !avr )
+	{
+		fprintf( stderr, "simavr has no atmega16 core\n" );
+		return NULL;
+	}
+	avr_init( avr );
+	avr->frequency = frequency;
+	if( load_firmware( avr, path ) != 0 )
+	{
+		fprintf( stderr, "can't load %s\n", path );
+		return NULL;
+	}
+	return avr;
+}
+
+
+/*-------------------------------------------------------------------------
+* Run one step of the core. 0 when it stopped or crashed.
+*------------------------------------------------------------------------*/
+int sim_step( avr_t * avr )
+{
+	int state = avr_run( avr );
+	return state != cpu_Done && state != cpu_Crashed;
+}
+
+
+/*-------------------------------------------------------------------------
+* 1 when the core is at the first instruction of a vector.
+*------------------------------------------------------------------------*/
+int sim_at_vector( avr_t * avr, int vector )
+{
+	return avr->pc == (unsigned int) vector * vector_size;
+}
+
+
+/*-------------------------------------------------------------------------
+* Stack pointer of the simulated core.
+*------------------------------------------------------------------------*/
+unsigned int sim_stack_pointer( avr_t * avr )
+{
+	return avr->data[R_SPL] | ( avr->data[R_SPH] << 8 );
+}
+
+
+/*-------------------------------------------------------------------------
+* UART_IRQ_INPUT or UART_IRQ_OUTPUT of the USART.
+*------------------------------------------------------------------------*/
+avr_irq_t * sim_uart_irq( avr_t * avr, int irq )
+{
+	return avr_io_getirq( avr, AVR_IOCTL_UART_GETIRQ( '0' ), irq );
+}
+
+
+/*-------------------------------------------------------------------------
+* Cycles of one USART frame at a baud rate.
+*------------------------------------------------------------------------*/
+avr_cycle_count_t sim_frame_cycles( unsigned long frequency, unsigned long baud )
+{
+	return (avr_cycle_count_t) frequency * bits_per_frame / baud;
+}
+
+
+/*-------------------------------------------------------------------------
+* Follow the interrupt service routine of isr->vector after every step, from
+* its vector to the instruction after reti. Returns the cycles of a run that
+* just ended, 0 otherwise.
+*------------------------------------------------------------------------*/
+avr_cycle_count_t sim_isr_step( avr_t * avr, struct sim_isr * isr )
+{
+	if( !isr->running )
+	{
+		if( sim_at_vector( avr, isr->vector ) )
+		{
+			isr->running = 1;
+			isr->start = avr->cycle;
+			// The return address is already pushed when the vector is reached
+			isr->return_sp = sim_stack_pointer( avr ) + 2;
+		}
+		return 0;
+	}
+	if( sim_stack_pointer( avr ) != isr->return_sp )
+		return 0;
+	// reti popped the return address
+	isr->running = 0;
+	return avr->cycle - isr->start;
+}
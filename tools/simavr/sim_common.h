@@ -0,0 +1,51 @@
+/*
+ * sim_common.h
+ *
+ * ATmega16 definitions and helpers shared by the simavr tools: vectors, USART
+ * frames, loading a firmware in a new core, the message argument and the time
+ * of an interrupt service routine.
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ */
+
+#ifndef SIM_COMMON_H_
+#define SIM_COMMON_H_
+
+#include <simavr/sim_avr.h>
+
+// ATmega16 vectors are one jmp (2 words) apart
+#define vector_size 4
+#define num_of_vectors 21
+#define USART_RXC_vector 11
+#define TIMER0_COMP_vector 19
+
+// 1 start, 8 data and 1 stop bit
+#define bits_per_frame 10
+
+#define default_frequency 10000000
+
+// ATmega16 interrupt vectors, same numbering as avr-libc
+extern const char * const vector_names[num_of_vectors];
+
+// Time of the runs of one interrupt service routine, see sim_isr_step
+struct sim_isr
+{
+	int vector;
+	int running;
+	avr_cycle_count_t start;
+	// Stack pointer after reti
+	unsigned int return_sp;
+};
+
+int sim_parse_vector( const char * text );
+unsigned int sim_parse_message( const char * text, char * out, unsigned int size );
+avr_t * sim_atmega16( const char * path, unsigned long frequency );
+int sim_step( avr_t * avr );
+int sim_at_vector( avr_t * avr, int vector );
+unsigned int sim_stack_pointer( avr_t * avr );
+avr_irq_t * sim_uart_irq( avr_t * avr, int irq );
+avr_cycle_count_t sim_frame_cycles( unsigned long frequency, unsigned long baud );
+avr_cycle_count_t sim_isr_step( avr_t * avr, struct sim_isr * isr );
+
+#endif /* SIM_COMMON_H_ */
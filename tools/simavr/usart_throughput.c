@@ -0,0 +1,178 @@
+/*
+ * usart_throughput.c
+ *
+ * Runs an ATmega16 firmware in simavr and streams a message back to back in the
+ * USART at a baud rate. Measures the sustained messages per second, counted by
+ * the acks the firmware sends back ("OK", or "OK n" for n merged acks), and the
+ * headroom of the receive ISR: how much of a frame time is left after its longest run.
+ *
+ * The firmware must be built with the same BAUD profile as the baud argument.
+ * The stream pauses between an XOFF and an XON of the firmware, like a host
+ * with software flow control.
+ *
+ * Build: gcc -O2 -o usart_throughput usart_throughput.c sim_common.c -lsimavr -lelf
+ * Usage: usart_throughput [-r] <firmware.elf|firmware.hex> <baud> [messages] [message] [frequency]
+ *        message accepts \r and \n, default "N12345678\r\n".
+ *        -r also loads every received frame in r20 at the USART_RXC vector,
+ *        like the stimuli files do, for firmware built with stimuli_input (Debug builds).
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_uart.h>
+#include "sim_common.h"
+
+// Software flow control bytes of the firmware
+#define XON 0x11
+#define XOFF 0x13
+
+#define default_messages 1000
+#define default_message "N12345678\\r\\n"
+
+// Acks still missing this many message times after the last frame are lost
+#define drain_messages 4
+
+
+// Stream state, shared with the callbacks
+static avr_irq_t * uart_input;
+static char message[64];
+static unsigned int message_length;
+static unsigned long frames_to_send;
+static unsigned long frames_sent;
+static unsigned long frames_received;
+static avr_cycle_count_t cycles_per_frame;
+static avr_cycle_count_t first_frame_cycle;
+static avr_cycle_count_t last_frame_cycle;
+static avr_cycle_count_t last_response_cycle;
+static unsigned long acked;
+static char line[32];
+static unsigned int line_length;
+static int stopped;
+static unsigned long xoffs;
+
+
+/*-------------------------------------------------------------------------
+* Send the next frame of the stream, one frame time after the previous one.
+*------------------------------------------------------------------------*/
+static avr_cycle_count_t send_frame( avr_t * avr, avr_cycle_count_t when, void * param )
+{
+	// Stopped by XOFF, check again after a frame time
+	if( stopped )
+		return when + cycles_per_frame;
+	if( frames_sent == 0 )
+		first_frame_cycle = avr->cycle;
+	avr_raise_irq( uart_input, (unsigned char) message[frames_sent % message_length] );
+	last_frame_cycle = avr->cycle;
+	frames_sent++;
+	return frames_sent < frames_to_send ? when + cycles_per_frame : 0;
+}
+
+
+/*-------------------------------------------------------------------------
+* Count the acked messages in the response lines of the firmware, and follow
+* its flow control.
+*------------------------------------------------------------------------*/
+static void receive_response( avr_irq_t * irq, uint32_t value, void * param )
+{
+	avr_t * avr = param;
+	if( value == XOFF )
+	{
+		stopped = 1;
+		xoffs++;
+	}
+	else if( value == XON )
+		stopped = 0;
+	else if( value == '\n' )
+	{
+		line[line_length] = 0;
+		if( strncmp( line, "OK", 2 ) == 0 )
+		{
+			acked += line[2] == ' ' ? strtoul( &line[3], NULL, 10 ) : 1;
+			last_response_cycle = avr->cycle;
+		}
+		line_length = 0;
+	}
+	else if( line_length < sizeof( line ) - 1 )
+		line[line_length++] = (char) value;
+}
+
+
+int main( int argc, char * argv[] )
+{
+	int load_r20 = 0;
+	if( argc > 1 && strcmp( argv[1], "-r" ) == 0 )
+	{
+		load_r20 = 1;
+		argc--;
+		argv++;
+	}
+	if( argc < 3 )
+	{
+		fprintf( stderr, "usage: usart_throughput [-r] <firmware.elf|firmware.hex> <baud> [messages] [message] [frequency]\n" );
+		return 1;
+	}
+
+	unsigned long baud = strtoul( argv[2], NULL, 0 );
+	unsigned long messages = argc > 3 ? strtoul( argv[3], NULL, 0 ) : default_messages;
+	message_length = sim_parse_message( argc > 4 ? argv[4] : default_message, message, sizeof( message ) );
+	unsigned long frequency = argc > 5 ? strtoul( argv[5], NULL, 0 ) : default_frequency;
+	if( message_length == 0 || baud == 0 || messages == 0 )
+	{
+		fprintf( stderr, "empty message, zero messages or zero baud rate\n" );
+		return 1;
+	}
+
+	avr_t * avr = sim_atmega16( argv[1], frequency );
+	if( !avr )
+		return 1;
+
+	uart_input = sim_uart_irq( avr, UART_IRQ_INPUT );
+	avr_irq_register_notify( sim_uart_irq( avr, UART_IRQ_OUTPUT ), receive_response, avr );
+	cycles_per_frame = sim_frame_cycles( frequency, baud );
+	frames_to_send = messages * message_length;
+	avr_cycle_timer_register( avr, cycles_per_frame, send_frame, NULL );
+
+	// Run until all messages are acked, or acks stop arriving after the stream ended
+	avr_cycle_count_t message_cycles = cycles_per_frame * message_length;
+	struct sim_isr isr = { .vector = USART_RXC_vector };
+	avr_cycle_count_t isr_max = 0;
+
+	while( acked < messages )
+	{
+		if( !sim_step( avr ) )
+			break;
+		if( frames_sent == frames_to_send &&
+			avr->cycle > last_frame_cycle + drain_messages * message_cycles )
+			break;
+
+		if( !isr.running && sim_at_vector( avr, USART_RXC_vector ) )
+		{
+			if( load_r20 )
+				avr->data[20] = (unsigned char) message[frames_received % message_length];
+			frames_received++;
+		}
+		avr_cycle_count_t cycles = sim_isr_step( avr, &isr );
+		if( cycles > isr_max )
+			isr_max = cycles;
+	}
+
+	if( acked == 0 )
+	{
+		printf( "%s: %lu baud, no acks\n", argv[1], baud );
+		return 1;
+	}
+	double seconds = (double) ( last_response_cycle - first_frame_cycle ) / frequency;
+	printf( "%s: %lu baud, messages %lu, acked %lu, %.1f messages/s (line limit %.1f)\n",
+		argv[1], baud, messages, acked, acked / seconds,
+		(double) baud / bits_per_frame / message_length );
+	printf( "%s: frame %llu cycles, RX ISR max %llu cycles, headroom %.1f%%, XOFF %lu\n",
+		argv[1], (unsigned long long) cycles_per_frame, (unsigned long long) isr_max,
+		100.0 * ( 1.0 - (double) isr_max / cycles_per_frame ), xoffs );
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * warm_start_time.c
+ *
+ * Runs an ATmega16 firmware in simavr and measures the cycles from a reset to
+ * the first refresh (TIMER0_COMP vector) for the three boot paths:
+ * cold (power-on), warm (watchdog reset, SRAM kept) and corrupted warm
+ * (watchdog reset with a byte of the kept state inverted).
+ * A message is streamed before every watchdog reset, so the firmware has state to keep.
+ *
+ * simavr's reset is not trusted to keep SRAM, the SRAM is copied before
+ * the reset and written back after it, like a real watchdog reset.
+ *
+ * Build: gcc -O2 -o warm_start_time warm_start_time.c sim_common.c -lsimavr -lelf
+ * Usage: warm_start_time [-r] <firmware.elf|firmware.hex> [address] [message] [baud] [frequency]
+ *        address is the data address of the byte to corrupt, e.g. of warm from
+ *        avr-nm program.elf (minus 0x800000). Without it the corrupted path is skipped.
+ *        message accepts \r and \n, default "N12345678\r\n".
+ *        -r also loads every received frame in r20 at the USART_RXC vector,
+ *        like the stimuli files do, for firmware built with stimuli_input (Debug builds).
+ *
+ * Created: 17/10/2026
+ * Author: Emmanouil Petrakos
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_uart.h>
+#include "sim_common.h"
+
+// MCUCSR in data space and its reset flags
+#define MCUCSR_address 0x54
+#define PORF_bit 0
+#define WDRF_bit 3
+
+// SRAM in data space
+#define sram_start 0x60
+#define sram_end 0x45F
+
+#define default_message "N12345678\\r\\n"
+#define default_baud 9600
+
+// Run after the message before the reset, for the parser and the response
+#define settle_ms 5
+// A boot path that doesn't refresh in this time failed
+#define timeout_ms 100
+
+
+// Stream state, shared with the cycle timer callback
+static avr_irq_t * uart_input;
+static char message[64];
+static unsigned int message_length;
+static unsigned long frames_sent;
+static unsigned long frames_received;
+static avr_cycle_count_t cycles_per_frame;
+static int load_r20;
+
+
+/*-------------------------------------------------------------------------
+* Send the next frame of the message, one frame time after the previous one.
+* Stops after the whole message.
+*------------------------------------------------------------------------*/
+static avr_cycle_count_t send_frame( avr_t * avr, avr_cycle_count_t when, void * param )
+{
+	avr_raise_irq( uart_input, (unsigned char) message[frames_sent % message_length] );
+	frames_sent++;
+	return frames_sent % message_length ? when + cycles_per_frame : 0;
+}
+
+
+/*-------------------------------------------------------------------------
+* Run for a number of cycles, or until the refresh vector if refresh is set.
+* Returns the cycles run, 0 if the core stopped or the refresh never came.
+*------------------------------------------------------------------------*/
+static avr_cycle_count_t run( avr_t * avr, avr_cycle_count_t cycles, int refresh )
+{
+	avr_cycle_count_t start = avr->cycle;
+	while( avr->cycle - start < cycles )
+	{
+		if( !sim_step( avr ) )
+			return 0;
+		if( load_r20 && sim_at_vector( avr, USART_RXC_vector ) )
+			avr->data[20] = (unsigned char) message[frames_received++ % message_length];
+		if( refresh && sim_at_vector( avr, TIMER0_COMP_vector ) )
+			return avr->cycle - start;
+	}
+	return refresh ? 0 : cycles;
+}
+
+
+/*-------------------------------------------------------------------------
+* Stream the message, then reset the core like the watchdog: SRAM kept,
+* WDRF set. corrupt is the data address of a byte to invert, 0 for none.
+*------------------------------------------------------------------------*/
+static int watchdog_reset( avr_t * avr, unsigned long frequency, unsigned int corrupt )
+{
+	static unsigned char sram[sram_end - sram_start + 1];
+
+	avr_cycle_timer_register( avr, cycles_per_frame, send_frame, NULL );
+	if( run( avr, cycles_per_frame * message_length + (avr_cycle_count_t) frequency * settle_ms / 1000, 0 ) == 0 )
+		return -1;
+	memcpy( sram, &avr->data[sram_start], sizeof( sram ) );
+	if( corrupt )
+		sram[corrupt - sram_start] ^= 0xFF;
+	avr_reset( avr );
+	memcpy( &avr->data[sram_start], sram, sizeof( sram ) );
+	avr->data[MCUCSR_address] = 1 << WDRF_bit;
+	return 0;
+}
+
+
+int main( int argc, char * argv[] )
+{
+	if( argc > 1 && strcmp( argv[1], "-r" ) == 0 )
+	{
+		load_r20 = 1;
+		argc--;
+		argv++;
+	}
+	if( argc < 2 )
+	{
+		fprintf( stderr, "usage: warm_start_time [-r] <firmware.elf|firmware.hex> [address] [message] [baud] [frequency]\n" );
+		return 1;
+	}
+
+	unsigned int corrupt = argc > 2 ? (unsigned int) strtoul( argv[2], NULL, 0 ) : 0;
+	message_length = sim_parse_message( argc > 3 ? argv[3] : default_message, message, sizeof( message ) );
+	unsigned long baud = argc > 4 ? strtoul( argv[4], NULL, 0 ) : default_baud;
+	unsigned long frequency = argc > 5 ? strtoul( argv[5], NULL, 0 ) : default_frequency;
+	if( message_length == 0 || baud == 0 )
+	{
+		fprintf( stderr, "empty message or zero baud rate\n" );
+		return 1;
+	}
+	if( corrupt && ( corrupt < sram_start || corrupt > sram_end ) )
+	{
+		fprintf( stderr, "address 0x%X isn't in SRAM (0x%X-0x%X)\n", corrupt, sram_start, sram_end );
+		return 1;
+	}
+
+	avr_t * avr = sim_atmega16( argv[1], frequency );
+	if( !avr )
+		return 1;
+
+	uart_input = sim_uart_irq( avr, UART_IRQ_INPUT );
+	cycles_per_frame = sim_frame_cycles( frequency, baud );
+	avr_cycle_count_t timeout = (avr_cycle_count_t) frequency * timeout_ms / 1000;
+
+	const char * paths[3] = { "cold", "warm", "corrupted warm" };
+	avr_cycle_count_t cycles[3] = { 0, 0, 0 };
+	int measured = corrupt ? 3 : 2;
+
+	avr->data[MCUCSR_address] = 1 << PORF_bit;
+	cycles[0] = run( avr, timeout, 1 );
+	for( int path = 1 ; path < measured && cycles[path - 1] ; path++ )
+	{
+		if( watchdog_reset( avr, frequency, path == 2 ? corrupt : 0 ) != 0 )
+			break;
+		cycles[path] = run( avr, timeout, 1 );
+	}
+
+	int failed = 0;
+	for( int path = 0 ; path < measured ; path++ )
+	{
+		if( cycles[path] == 0 )
+		{
+			printf( "%s: %s start, no refresh\n", argv[1], paths[path] );
+			failed = 1;
+			continue;
+		}
+		printf( "%s: %s start, reset to first refresh %llu cycles (%.1f us)\n",
+			argv[1], paths[path], (unsigned long long) cycles[path],
+			1e6 * cycles[path] / frequency );
+	}
+	if( !corrupt )
+		printf( "%s: corrupted warm start skipped, no address\n", argv[1] );
+	return failed;
+}